@@ -0,0 +1,28 @@
+#!/bin/bash
+# bench_layouts.sh
+
+# Fire is a freeware UCI chess playing engine authored by Norman Schmidt.
+#  
+# Fire is free software: you can redistribute it and/or modify it under the
+# terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or any later version.
+# 
+# You should have received a copy of the GNU General Public License with
+# this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
+
+# build fire once for every transposition table bucket layout (with hash
+#  statistics enabled) and compare nps, hash hit rate and time to depth
+#  usage: ./bench_layouts.sh [depth] [arch]
+
+depth=${1:-16}
+arch_cpu=${2:-x86-64-bmi2}
+
+for layout in 3x16 4x32 2x64 split xor
+do
+	make --no-print-directory clean > /dev/null
+	make --no-print-directory -j build ARCH=${arch_cpu} COMP=gcc hashstats=yes hashlayout=${layout} > /dev/null || exit 1
+	echo "layout ${layout}"
+	./fire bench ${depth} | grep -E "^(nps|ttd|hash hits)"
+	echo ""
+done
+make --no-print-directory clean > /dev/null
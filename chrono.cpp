@@ -79,5 +79,3 @@ int64_t timecontrol::elapsed() const
 {
 	return now() - start_time_;
 }
-
-timecontrol time_control;
\ No newline at end of file
@@ -26,6 +26,12 @@ inline time_point now()
 		(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
+inline int64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>
+		(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 struct search_param
 {
 	search_param() : moves_to_go(0), depth(0), move_time(0), mate(0), infinite(0), ponder(0), nodes(time[white]
@@ -77,4 +83,3 @@ private:
 	int move_overhead_ = 10;
 };
 
-extern timecontrol time_control;
@@ -36,6 +36,20 @@ constexpr bool use_pext = false;
 #endif
 #endif
 
+// transposition table counters (hits, misses, replacements), enabled with 'make hashstats=yes'
+#ifdef HASH_STATS
+constexpr bool use_hash_stats = true;
+#else
+constexpr bool use_hash_stats = false;
+#endif
+
+// search counters (node types, cutoffs, pruning, reductions, extensions) per iteration, enabled with 'make searchstats=yes'
+#ifdef SEARCH_STATS
+constexpr bool use_search_stats = true;
+#else
+constexpr bool use_search_stats = false;
+#endif
+
 // many new instructions require data that's aligned to 16-byte boundaries, so 64-byte alignment improves performance
 #ifdef _MSC_VER
 #define CACHE_ALIGN __declspec(align(64))
@@ -44,7 +58,7 @@ constexpr bool use_pext = false;
 #endif
 
 #if defined(__INTEL_COMPILER) || defined(_MSC_VER)
-#include <xmmintrin.h>
+#include <emmintrin.h>
 #endif
 
 // increase speed by having the compiler prefetch data from memory
@@ -76,4 +90,16 @@ inline void prefetch2(void* address)
 #endif
 }
 
+// hint to the cpu that this is a spin-wait loop, leaving the core's resources to a sibling hyperthread
+inline void cpu_relax()
+{
+#if defined(_MSC_VER)
+	_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
 
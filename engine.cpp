@@ -0,0 +1,35 @@
+/*
+  Fire is a freeware UCI chess playing engine authored by Norman Schmidt.
+
+  Fire utilizes many state-of-the-art chess programming ideas and techniques
+  which have been documented in detail at https://www.chessprogramming.org/
+  and demonstrated via the very strong open-source chess engine Stockfish...
+  https://github.com/official-stockfish/Stockfish.
+  
+  Fire is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or any later version.
+
+  You should have received a copy of the GNU General Public License with
+  this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "engine.h"
+
+engine main_engine;
+
+// bind the calling thread to this instance, then start its thread pool and allocate its hash.
+// the process wide tables must have been initialized already
+void engine::init(const int hash_size)
+{
+	this_engine = this;
+	thread_pool.start = now();
+	thread_pool.init();
+	search::reset();
+	main_hash.init(hash_size);
+}
+
+void engine::exit()
+{
+	thread_pool.exit();
+}
@@ -0,0 +1,127 @@
+/*
+  Fire is a freeware UCI chess playing engine authored by Norman Schmidt.
+
+  Fire utilizes many state-of-the-art chess programming ideas and techniques
+  which have been documented in detail at https://www.chessprogramming.org/
+  and demonstrated via the very strong open-source chess engine Stockfish...
+  https://github.com/official-stockfish/Stockfish.
+  
+  Fire is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or any later version.
+
+  You should have received a copy of the GNU General Public License with
+  this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "chrono.h"
+#include "hash.h"
+#include "mate.h"
+#include "search.h"
+#include "thread.h"
+
+// one independent engine instance: its hash tables, thread pool, time control and search state.
+// several instances can search at once in one process, each driven by its own thread. the read-only
+// tables (bitboards, magics, pst, evaluation, kpk bitbase, syzygy files) and the uci option values are shared
+struct engine
+{
+	void init(int hash_size);
+	void exit();
+
+	hash main_hash;
+	pv_hash pv_table;
+	busy_hash busy_table;
+	mate::solver mate_solver;
+	threadpool thread_pool;
+	timecontrol time_control;
+	search::searchstate search_state{};
+};
+
+// the instance the calling thread works for: set by the thread driving it and by every thread of its pool
+inline thread_local engine* this_engine;
+
+extern engine main_engine;
+
+inline hash& main_hash()
+{
+	return this_engine->main_hash;
+}
+
+inline pv_hash& pv_table()
+{
+	return this_engine->pv_table;
+}
+
+inline busy_hash& busy_table()
+{
+	return this_engine->busy_table;
+}
+
+inline mate::solver& mate_solver()
+{
+	return this_engine->mate_solver;
+}
+
+inline threadpool& thread_pool()
+{
+	return this_engine->thread_pool;
+}
+
+inline timecontrol& time_control()
+{
+	return this_engine->time_control;
+}
+
+namespace search
+{
+	inline search_signals& signals()
+	{
+		return this_engine->search_state.signals;
+	}
+
+	inline search_param& param()
+	{
+		return this_engine->search_state.param;
+	}
+
+	inline bool& running()
+	{
+		return this_engine->search_state.running;
+	}
+
+	inline easy_move_manager& easy_move()
+	{
+		return this_engine->search_state.easy_move;
+	}
+
+	inline int* draw()
+	{
+		return this_engine->search_state.draw;
+	}
+
+	inline uint64_t& previous_info_time()
+	{
+		return this_engine->search_state.previous_info_time;
+	}
+}
+
+inline int& tb_number()
+{
+	return this_engine->search_state.tb_number;
+}
+
+inline bool& tb_root_in_tb()
+{
+	return this_engine->search_state.tb_root_in_tb;
+}
+
+inline int& tb_probe_depth()
+{
+	return this_engine->search_state.tb_probe_depth;
+}
+
+inline int& tb_score()
+{
+	return this_engine->search_state.tb_score;
+}
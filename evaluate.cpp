@@ -17,6 +17,7 @@
 #include "evaluate.h"
 #include "endgame.h"
 #include "bitboard.h"
+#include "engine.h"
 #include "fire.h"
 #include "material.h"
 #include "pawn.h"
@@ -926,7 +927,8 @@ namespace evaluate
 		pi->eval_factor = static_cast<uint8_t>(eval_factor);
 		val += material_entry->value * eval_factor / max_factor;
 
-		if (thread_pool.piece_contempt)
+		const auto& pool = pos.instance().thread_pool;
+		if (pool.piece_contempt)
 		{
 			constexpr auto contempt_mult = 4;
 			constexpr auto queen_contempt_mult = 8;
@@ -934,11 +936,11 @@ namespace evaluate
 			constexpr auto bishop_contempt_mult = 3;
 			constexpr auto knight_contempt_mult = 2;
 			constexpr auto pawn_contempt_mult = 2;
-			const auto contempt_number = pawn_contempt_mult * pos.number(thread_pool.contempt_color, pt_pawn)
-				+ knight_contempt_mult * pos.number(thread_pool.contempt_color, pt_knight) + bishop_contempt_mult * pos.number(thread_pool.contempt_color, pt_bishop)
-				+ rook_contempt_mult * pos.number(thread_pool.contempt_color, pt_rook) + queen_contempt_mult * pos.number(thread_pool.contempt_color, pt_queen);
+			const auto contempt_number = pawn_contempt_mult * pos.number(pool.contempt_color, pt_pawn)
+				+ knight_contempt_mult * pos.number(pool.contempt_color, pt_knight) + bishop_contempt_mult * pos.number(pool.contempt_color, pt_bishop)
+				+ rook_contempt_mult * pos.number(pool.contempt_color, pt_rook) + queen_contempt_mult * pos.number(pool.contempt_color, pt_queen);
 
-			if (const auto contempt_score = contempt_mult * thread_pool.piece_contempt * contempt_number * eval_factor / max_factor; thread_pool.contempt_color == white)
+			if (const auto contempt_score = contempt_mult * pool.piece_contempt * contempt_number * eval_factor / max_factor; pool.contempt_color == white)
 				val += static_cast<int>(contempt_score);
 			else
 				val -= static_cast<int>(contempt_score);
@@ -949,8 +951,8 @@ namespace evaluate
 
 		auto result = val / eval_value_div + value_tempo;
 
-		if (pos.fifty_move_counter() > thread_pool.fifty_move_distance)
-			result = result * (5 * (2 * thread_pool.fifty_move_distance - pos.fifty_move_counter()) + 6) / 256;
+		if (pos.fifty_move_counter() > pool.fifty_move_distance)
+			result = result * (5 * (2 * pool.fifty_move_distance - pos.fifty_move_counter()) + 6) / 256;
 
 		if (!pos.non_pawn_material(pos.on_move()))
 		{
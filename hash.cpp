@@ -14,29 +14,161 @@
   this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
 
 #include "hash.h"
 
 #include "bitboard.h"
+#include "engine.h"
 #include "fire.h"
+#include "thread.h"
+#include "uci.h"
+#include "util/util.h"
+#include "zobrist.h"
+
+
+namespace
+{
+	constexpr size_t huge_page_2m = static_cast<size_t>(1) << 21;
+	constexpr size_t huge_page_1g = static_cast<size_t>(1) << 30;
+
+	// hash file layout: one page of header followed by the raw bucket array,
+	// so the buckets can be memory mapped straight from the file
+	constexpr char hash_file_magic[8] = {'F', 'I', 'R', 'E', 'H', 'A', 'S', 'H'};
+	constexpr uint32_t hash_file_version = 3;
+	constexpr size_t hash_file_header_size = 4096;
+
+	struct hash_file_header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t layout;
+		uint32_t entry_size;
+		uint32_t bucket_entries;
+		uint32_t bucket_size;
+		uint64_t buckets;
+		uint8_t age;
+		uint64_t key_scheme;
+	};
+
+	// a shared hash segment starts with one page holding the sharedcontrol block, followed by the buckets
+	constexpr size_t shared_header_size = 4096;
+	static_assert(sizeof(sharedcontrol) <= shared_header_size, "shared control block too large");
+
+#ifdef __linux__
+	// lock the control block of a shared segment. when a process died holding the lock the root
+	// result may be half written, so it is dropped and the mutex marked usable again
+	void lock_control(sharedcontrol* control)
+	{
+		if (pthread_mutex_lock(&control->lock) == EOWNERDEAD)
+		{
+			control->root = {};
+			pthread_mutex_consistent(&control->lock);
+		}
+	}
+
+	void unlock_control(sharedcontrol* control)
+	{
+		pthread_mutex_unlock(&control->lock);
+	}
 
-hash main_hash;
+	// whether the process with this pid is still running: a zombie has exited but still has its pid
+	bool process_alive(const int32_t pid)
+	{
+		if (kill(pid, 0) != 0 && errno != EPERM)
+			return false;
+
+		std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+		std::string line;
+		std::getline(stat, line);
+		const auto state = line.rfind(')');
+		return state == std::string::npos || state + 2 >= line.size() || line[state + 2] != 'Z';
+	}
+
+	// number of live processes attached to a shared segment, freeing the slots of processes
+	// that exited without detaching. called with the control block locked
+	int live_processes(sharedcontrol* control)
+	{
+		auto processes = 0;
+		for (auto& pid : control->pids)
+		{
+			if (!pid)
+				continue;
+			if (process_alive(pid))
+				++processes;
+			else
+				pid = 0;
+		}
+		return processes;
+	}
+#endif
+
+	void free_memory(void* mem, const size_t size, const hashmemory type)
+	{
+#ifdef __linux__
+		if (type == mem_huge_1g || type == mem_huge_2m || type == mem_file)
+			munmap(mem, size);
+		else
+			free(mem);
+#elif defined(_WIN32)
+		(void)size;
+		(void)type;
+		_aligned_free(mem);
+#else
+		(void)size;
+		(void)type;
+		free(mem);
+#endif
+	}
+
+	const char* memory_name(const hashmemory type)
+	{
+		switch (type)
+		{
+		case mem_huge_1g: return "1 GB huge pages";
+		case mem_huge_2m: return "2 MB huge pages";
+		case mem_transparent: return "transparent huge pages";
+		case mem_standard: return "standard pages";
+		case mem_file: return "mapped file";
+		case mem_shared: return "shared memory";
+		default: return "none";
+		}
+	}
+}
 
 // set hash size in MB
-void hash::init(const size_t mb_size)
+template <typename layout>
+void transposition_table<layout>::init(const size_t mb_size)
 {
 	const auto new_size = static_cast<size_t>(1) << msb(mb_size * 1024 * 1024 / sizeof(bucket));
 
 	if (new_size == buckets_)
 		return;
 
-	buckets_ = new_size;
-
-	if (hash_mem_)
-		free(hash_mem_);
+	release();
 
-	hash_mem_ = static_cast<bucket*>(calloc(buckets_ * sizeof(bucket) + 63, 1));
+	hash_mem_ = static_cast<bucket*>(allocate(new_size * sizeof(bucket)));
 
 	if (!hash_mem_)
 	{
@@ -47,62 +179,946 @@ void hash::init(const size_t mb_size)
 
 	buckets_ = new_size;
 	bucket_mask_ = (buckets_ - 1) * sizeof(bucket);
+
+	// pages are placed on first touch, so set the NUMA policy before clearing
+	numa::place(hash_mem_, buckets_ * sizeof(bucket), numa_policy_);
+	clear();
+
+	if (!bench_active)
+		acout() << "info string Hash memory: " << memory_name(mem_type_)
+			<< ", numa " << numa::policy_name(numa_policy_) << std::endl;
+}
+
+// enable or disable huge page backing, re-allocating the table if the mode changes
+template <typename layout>
+void transposition_table<layout>::large_pages(const bool enable)
+{
+	if (enable == large_pages_)
+		return;
+
+	large_pages_ = enable;
+	rebuild(buckets_);
+}
+
+// select how the table is spread over NUMA nodes, re-allocating the table if the policy changes
+template <typename layout>
+void transposition_table<layout>::numa_policy(const numapolicy policy)
+{
+	if (policy == numa_policy_)
+		return;
+
+	numa_policy_ = policy;
+	rebuild(buckets_);
+}
+
+// set hash size in MB, keeping the entries of the current table
+template <typename layout>
+void transposition_table<layout>::resize(const size_t mb_size)
+{
+	if (!hash_mem_)
+	{
+		init(mb_size);
+		return;
+	}
+
+	// a shared table keeps the size its segment was created with
+	if (control_)
+		return;
+
+	const auto new_size = static_cast<size_t>(1) << msb(mb_size * 1024 * 1024 / sizeof(bucket));
+
+	if (new_size != buckets_)
+		rebuild(new_size);
+}
+
+// move the table into freshly allocated memory of new_buckets buckets, rehashing in parallel.
+// a bucket index holds the low key bits, so when shrinking the old buckets sharing those bits
+// are merged keeping the deepest entries; when growing the missing bits are unknown and every
+// old bucket is copied to all new buckets it may map to (the wrong copies age out as misses)
+template <typename layout>
+void transposition_table<layout>::rebuild(const size_t new_buckets)
+{
+	if (!hash_mem_ || control_)
+		return;
+
+	auto* const old_mem = hash_mem_;
+	const auto old_buckets = buckets_;
+	const auto old_size = mem_size_;
+	const auto old_type = mem_type_;
+
+	hash_mem_ = static_cast<bucket*>(allocate(new_buckets * sizeof(bucket)));
+
+	if (!hash_mem_)
+	{
+		std::cerr << "Failed to allocate " << (new_buckets * sizeof(bucket) >> 20)
+			<< "MB for transposition table." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	numa::place(hash_mem_, new_buckets * sizeof(bucket), numa_policy_);
+
+	thread_pool().parallel_for(new_buckets, [&](const size_t begin, const size_t end)
+		{
+			for (auto b = begin; b < end; ++b)
+				if (new_buckets >= old_buckets)
+					hash_mem_[b] = old_mem[b & (old_buckets - 1)];
+				else
+					merge(hash_mem_[b], old_mem + b, new_buckets, old_buckets / new_buckets);
+		});
+
+	free_memory(old_mem, old_size, old_type);
+
+	buckets_ = new_buckets;
+	bucket_mask_ = (buckets_ - 1) * sizeof(bucket);
+
+	if (!bench_active)
+		acout() << "info string Hash memory: " << memory_name(mem_type_)
+			<< ", numa " << numa::policy_name(numa_policy_) << ", entries kept" << std::endl;
+}
+
+// fill target with the most valuable entries of count buckets spaced stride apart
+template <typename layout>
+void transposition_table<layout>::merge(bucket& target, const bucket* source, const size_t stride, const size_t count) const
+{
+	target = {};
+	auto used = 0;
+
+	for (size_t i = 0; i < count; ++i)
+		for (const auto& e : source[i * stride].entry)
+		{
+			if (!e.stored_key())
+				continue;
+
+			// same key in one bucket is the same position (possibly a copy made when growing)
+			auto* same = std::find_if(target.entry, target.entry + used, [&e](const entry_type& t)
+				{
+					return t.stored_key() == e.stored_key();
+				});
+			if (same != target.entry + used)
+			{
+				if (priority(e) > priority(*same))
+					*same = e;
+				continue;
+			}
+
+			if (used < bucket_size)
+			{
+				target.entry[used++] = e;
+				continue;
+			}
+
+			auto* weakest = &target.entry[0];
+			for (auto& t : target.entry)
+				if (priority(t) < priority(*weakest))
+					weakest = &t;
+
+			if (priority(e) > priority(*weakest))
+				*weakest = e;
+		}
+
+	if constexpr (layout::depth_slot)
+	{
+		auto* deepest = std::max_element(target.entry, target.entry + used, [this](const entry_type& a, const entry_type& b)
+			{
+				return priority(a) < priority(b);
+			});
+		if (deepest != target.entry + used)
+			std::swap(*deepest, target.entry[0]);
+	}
+}
+
+// get memory for the table, trying explicit 1 GB and 2 MB huge pages first,
+// then transparent huge pages, and finally plain calloc
+template <typename layout>
+void* transposition_table<layout>::allocate(const size_t size)
+{
+#ifdef __linux__
+	if (large_pages_)
+	{
+#ifdef MAP_HUGE_1GB
+		if (size >= huge_page_1g && size % huge_page_1g == 0)
+		{
+			if (auto* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0); mem != MAP_FAILED)
+			{
+				mem_type_ = mem_huge_1g;
+				mem_size_ = size;
+				return mem;
+			}
+		}
+#endif
+		if (size % huge_page_2m == 0)
+		{
+			if (auto* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0); mem != MAP_FAILED)
+			{
+				mem_type_ = mem_huge_2m;
+				mem_size_ = size;
+				return mem;
+			}
+		}
+
+		const auto rounded = (size + huge_page_2m - 1) / huge_page_2m * huge_page_2m;
+		if (auto* mem = std::aligned_alloc(huge_page_2m, rounded))
+		{
+			mem_type_ = madvise(mem, rounded, MADV_HUGEPAGE) == 0 ? mem_transparent : mem_standard;
+			mem_size_ = rounded;
+			return mem;
+		}
+	}
+#endif
+
+	// buckets must start on their own alignment, a full cache line for the one line layouts
+	constexpr size_t alignment = alignof(bucket) > 64 ? alignof(bucket) : 64;
+	const auto rounded = (size + alignment - 1) / alignment * alignment;
+#ifdef _WIN32
+	auto* mem = _aligned_malloc(rounded, alignment);
+#else
+	auto* mem = std::aligned_alloc(alignment, rounded);
+#endif
+	if (mem)
+		std::memset(mem, 0, rounded);
+
+	mem_type_ = mem_standard;
+	mem_size_ = rounded;
+	return mem;
+}
+
+// return the table memory to the OS using the call matching how it was obtained
+template <typename layout>
+void transposition_table<layout>::release()
+{
+	if (!hash_mem_)
+		return;
+
+#ifdef __linux__
+	if (control_)
+	{
+		// the last live process to detach removes the segment
+		lock_control(control_);
+		std::replace(std::begin(control_->pids), std::end(control_->pids), static_cast<int32_t>(getpid()), 0);
+		if (!live_processes(control_))
+			shm_unlink(shared_name_.c_str());
+		unlock_control(control_);
+
+		munmap(control_, mem_size_);
+		control_ = nullptr;
+		shared_name_.clear();
+	}
+	else
+#endif
+		free_memory(hash_mem_, mem_size_, mem_type_);
+
+	hash_mem_ = nullptr;
+	buckets_ = 0;
+	mem_size_ = 0;
+	mem_type_ = mem_none;
+}
+
+// write header and bucket array to disk
+template <typename layout>
+bool transposition_table<layout>::save(const std::string& file_name) const
+{
+	if (!hash_mem_)
+		return false;
+
+	std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	char header_page[hash_file_header_size]{};
+	hash_file_header header{};
+	std::memcpy(header.magic, hash_file_magic, sizeof header.magic);
+	header.version = hash_file_version;
+	header.layout = layout::id;
+	header.entry_size = sizeof(entry_type);
+	header.bucket_entries = bucket_size;
+	header.bucket_size = sizeof(bucket);
+	header.buckets = buckets_;
+	header.age = age_;
+	header.key_scheme = zobrist::scheme();
+	std::memcpy(header_page, &header, sizeof header);
+
+	file.write(header_page, sizeof header_page);
+	file.write(reinterpret_cast<const char*>(hash_mem_), static_cast<std::streamsize>(buckets_ * sizeof(bucket)));
+	return static_cast<bool>(file);
+}
+
+// replace the table with one saved by hash::save, taking over its size and age;
+// on linux the buckets are mapped copy-on-write from the file, so pages are only read when probed
+template <typename layout>
+bool transposition_table<layout>::load(const std::string& file_name)
+{
+	std::ifstream file(file_name, std::ios::binary);
+	if (!file)
+		return false;
+
+	hash_file_header header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof header);
+
+	if (!file
+		|| std::memcmp(header.magic, hash_file_magic, sizeof header.magic) != 0
+		|| header.version != hash_file_version
+		|| header.layout != layout::id
+		|| header.entry_size != sizeof(entry_type)
+		|| header.bucket_entries != bucket_size
+		|| header.bucket_size != sizeof(bucket)
+		|| !header.buckets
+		|| header.buckets & (header.buckets - 1)
+		|| header.key_scheme != zobrist::scheme())
+		return false;
+
+	const auto size = header.buckets * sizeof(bucket);
+
+	file.seekg(0, std::ios::end);
+	if (static_cast<size_t>(file.tellg()) < hash_file_header_size + size)
+		return false;
+
+	release();
+
+#ifdef __linux__
+	if (const auto fd = open(file_name.c_str(), O_RDONLY); fd >= 0)
+	{
+		auto* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, hash_file_header_size);
+		close(fd);
+
+		if (mem != MAP_FAILED)
+		{
+			hash_mem_ = static_cast<bucket*>(mem);
+			mem_type_ = mem_file;
+			mem_size_ = size;
+		}
+	}
+#endif
+
+	if (!hash_mem_)
+	{
+		hash_mem_ = static_cast<bucket*>(allocate(size));
+		if (!hash_mem_)
+		{
+			std::cerr << "Failed to allocate " << (size >> 20)
+				<< "MB for transposition table." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+
+		file.seekg(hash_file_header_size);
+		file.read(reinterpret_cast<char*>(hash_mem_), static_cast<std::streamsize>(size));
+	}
+
+	buckets_ = header.buckets;
+	bucket_mask_ = (buckets_ - 1) * sizeof(bucket);
+	age_ = header.age & age_mask;
+
+	return static_cast<bool>(file);
+}
+
+// replace the table with one in the named POSIX shared memory segment, so separate engine processes search
+// with one table as extra lazy smp helpers. the first process creates the segment with a table of mb_size,
+// the others attach to it and take over its size. an empty name, or a segment that cannot be used,
+// leaves the process with a private table of mb_size
+template <typename layout>
+bool transposition_table<layout>::share(const std::string& name, const size_t mb_size)
+{
+	release();
+
+	if (!name.empty() && attach(name, mb_size))
+		return true;
+
+	init(mb_size);
+	return name.empty();
+}
+
+template <typename layout>
+bool transposition_table<layout>::attach(const std::string& name, const size_t mb_size)
+{
+#ifdef __linux__
+	const auto segment = "/fire-" + name;
+	auto size = (static_cast<size_t>(1) << msb(mb_size * 1024 * 1024 / sizeof(bucket))) * sizeof(bucket);
+
+	auto created = true;
+	auto fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST)
+	{
+		created = false;
+		fd = shm_open(segment.c_str(), O_RDWR, 0600);
+	}
+	if (fd < 0)
+		return false;
+
+	if (created)
+	{
+		// tmpfs pages read as zero, so the new table is already clear
+		if (ftruncate(fd, static_cast<off_t>(shared_header_size + size)) != 0)
+		{
+			close(fd);
+			shm_unlink(segment.c_str());
+			return false;
+		}
+	}
+	else
+	{
+		// the creating process may not have sized the segment yet
+		struct stat st{};
+		for (auto i = 0; i < 1000 && fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) <= shared_header_size; ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		if (static_cast<size_t>(st.st_size) <= shared_header_size)
+		{
+			close(fd);
+			return false;
+		}
+		size = static_cast<size_t>(st.st_size) - shared_header_size;
+	}
+
+	auto* mem = mmap(nullptr, shared_header_size + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED)
+	{
+		if (created)
+			shm_unlink(segment.c_str());
+		return false;
+	}
+
+	auto* control = static_cast<sharedcontrol*>(mem);
+
+	if (created)
+	{
+		control->layout = layout::id;
+		control->bucket_size = sizeof(bucket);
+		control->buckets = size / sizeof(bucket);
+		control->age.store(age_, std::memory_order_relaxed);
+		control->pids[0] = getpid();
+
+		pthread_mutexattr_t attr;
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+		pthread_mutex_init(&control->lock, &attr);
+		pthread_mutexattr_destroy(&attr);
+
+		control->ready.store(1, std::memory_order_release);
+	}
+	else
+	{
+		for (auto i = 0; i < 1000 && !control->ready.load(std::memory_order_acquire); ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		if (!control->ready.load(std::memory_order_acquire)
+			|| control->layout != layout::id
+			|| control->bucket_size != sizeof(bucket)
+			|| control->buckets * sizeof(bucket) != size
+			|| control->buckets & (control->buckets - 1))
+		{
+			munmap(mem, shared_header_size + size);
+			return false;
+		}
+
+		lock_control(control);
+		live_processes(control);
+		auto* const slot = std::find(std::begin(control->pids), std::end(control->pids), 0);
+		if (slot != std::end(control->pids))
+			*slot = getpid();
+		unlock_control(control);
+
+		if (slot == std::end(control->pids))
+		{
+			munmap(mem, shared_header_size + size);
+			return false;
+		}
+	}
+
+	control_ = control;
+	shared_name_ = segment;
+	hash_mem_ = reinterpret_cast<bucket*>(static_cast<char*>(mem) + shared_header_size);
+	mem_type_ = mem_shared;
+	mem_size_ = shared_header_size + size;
+	buckets_ = control->buckets;
+	bucket_mask_ = (buckets_ - 1) * sizeof(bucket);
+	age_ = control->age.load(std::memory_order_relaxed);
+
+	if (!bench_active)
+		acout() << "info string Hash memory: " << memory_name(mem_type_) << " " << segment
+			<< (created ? " created, " : " attached, ") << (size >> 20) << " MB, "
+			<< shared_processes() << " processes" << std::endl;
+	return true;
+#else
+	(void)name;
+	(void)mb_size;
+	return false;
+#endif
+}
+
+// start a new search age. processes sharing a table keep one age: the first of them to start
+// a new search advances it and the others take it over, so they do not age each other's entries
+template <typename layout>
+void transposition_table<layout>::new_age()
+{
+	if (!control_)
+	{
+		age_ = age_ + 8 & age_mask;
+		return;
+	}
+
+	if (auto age = control_->age.load(std::memory_order_relaxed); age == age_)
+		control_->age.compare_exchange_strong(age, static_cast<uint8_t>(age + 8 & age_mask), std::memory_order_relaxed);
+	age_ = control_->age.load(std::memory_order_relaxed);
+}
+
+// record a completed root iteration for the other processes sharing the table,
+// keeping only the deepest one for the current root position
+template <typename layout>
+void transposition_table<layout>::publish_root(const sharedroot& result) const
+{
+#ifdef __linux__
+	if (!control_)
+		return;
+
+	lock_control(control_);
+
+	if (control_->root.key != result.key || result.depth > control_->root.depth)
+		control_->root = result;
+
+	unlock_control(control_);
+#else
+	(void)result;
+#endif
+}
+
+// the deepest root iteration any process sharing the table completed for the position with this key
+template <typename layout>
+bool transposition_table<layout>::shared_root(const uint64_t key, sharedroot& result) const
+{
+#ifdef __linux__
+	if (!control_)
+		return false;
+
+	lock_control(control_);
+	result = control_->root;
+	unlock_control(control_);
+
+	return result.key == key;
+#else
+	(void)key;
+	(void)result;
+	return false;
+#endif
 }
 
-// reset allocated memory to 0
-void hash::clear() const
+// the number of live processes attached to the shared table, 0 for a private table
+template <typename layout>
+int transposition_table<layout>::shared_processes() const
 {
-	std::memset(hash_mem_, 0, buckets_ * sizeof(bucket));
+#ifdef __linux__
+	if (!control_)
+		return 0;
+
+	lock_control(control_);
+	const auto processes = live_processes(control_);
+	unlock_control(control_);
+
+	return processes;
+#else
+	return 0;
+#endif
 }
 
-// probe exiting entries transposition table
-main_hash_entry* hash::probe(const uint64_t key) const
+// reset allocated memory to 0, each pool thread clearing its own slice of buckets
+// (this is also the first touch after allocation, so pages are spread over the threads' nodes).
+// a shared table is only cleared by a process that has it to itself, so one process starting a new
+// game does not wipe the entries the others are searching with; returns whether the table was cleared
+template <typename layout>
+bool transposition_table<layout>::clear() const
+{
+	if (!hash_mem_ || shared_processes() > 1)
+		return false;
+
+	thread_pool().parallel_for(buckets_, [this](const size_t begin, const size_t end)
+		{
+			std::memset(&hash_mem_[begin], 0, (end - begin) * sizeof(bucket));
+		});
+	return true;
+}
+
+// probe exiting entries transposition table; the entry found is copied to found, so the caller reads
+// the state that matched the key even when another thread overwrites the slot meanwhile
+template <typename layout>
+const typename layout::entry_type* transposition_table<layout>::probe(const uint64_t key, entry_type& found) const
 {
 	auto* const hash_entry = entry(key);
-	const uint16_t key16 = key >> 48;
+	const auto key_bits = entry_type::key_bits(key);
+
+	if constexpr (use_hash_stats)
+		++hashstats::local().probes;
 
 	for (auto i = 0; i < bucket_size; ++i)
-		if (hash_entry[i].key_ == key16)
+	{
+		found = hash_entry[i].snapshot();
+		if (found.stored_key() == key_bits)
 		{
-			if ((hash_entry[i].flags_ & age_mask) != age_)
-				hash_entry[i].flags_ = static_cast<uint8_t>(age_ + (hash_entry[i].flags_ & flags_mask));
+			if (found.age() != age_)
+				hash_entry[i].set_age(key_bits, age_);
 
-			return &hash_entry[i];
+			if constexpr (use_hash_stats)
+				++hashstats::local().hits;
+
+			return &found;
 		}
 
+		if constexpr (use_hash_stats)
+		{
+			if (found.stored_key())
+				++hashstats::local().key_compares;
+		}
+	}
+
 	return nullptr;
 }
 
 // overwrite existing entry if aged
-main_hash_entry* hash::replace(const uint64_t key) const
+template <typename layout>
+typename layout::entry_type* transposition_table<layout>::replace(const uint64_t key) const
 {
 	auto* const hash_entry = entry(key);
-	const uint16_t key16 = key >> 48;
+	const auto key_bits = entry_type::key_bits(key);
 
 	for (auto i = 0; i < bucket_size; ++i)
-		if (hash_entry[i].key_ == 0 || hash_entry[i].key_ == key16)
+		if (!hash_entry[i].stored_key() || hash_entry[i].stored_key() == key_bits)
+		{
+			if constexpr (use_hash_stats)
+				++(hash_entry[i].stored_key() ? hashstats::local().replace_same : hashstats::local().replace_empty);
+
 			return &hash_entry[i];
+		}
+
+	// with a depth-preferred slot only the always-replace slots are candidates
+	constexpr auto first = layout::depth_slot ? 1 : 0;
 
-	auto* replacement = hash_entry;
-	for (auto i = 1; i < bucket_size; ++i)
-		if (replacement->depth_ - (age_ - (replacement->flags_ & age_mask) & age_mask)
-			> hash_entry[i].depth_ - (age_ - (hash_entry[i].flags_ & age_mask) & age_mask))
+	auto* replacement = &hash_entry[first];
+	for (auto i = first + 1; i < bucket_size; ++i)
+		if (priority(*replacement) > priority(hash_entry[i]))
 			replacement = &hash_entry[i];
 
+	if constexpr (use_hash_stats)
+		++(replacement->age() != age_ ? hashstats::local().replace_aged : hashstats::local().replace_shallow);
+
+	// the evicted entry is promoted when it is worth more than the depth-preferred one,
+	// which then takes its place and is overwritten instead
+	if constexpr (layout::depth_slot)
+		if (priority(*replacement) > priority(hash_entry[0]))
+			std::swap(*replacement, hash_entry[0]);
+
 	return replacement;
 }
 
+// scan the whole table: slot occupancy per bucket and share of entries from the current search
+template <typename layout>
+std::string transposition_table<layout>::occupancy() const
+{
+	if (!hash_mem_)
+		return "info string hashstats no table";
+
+	// index 0..bucket_size: buckets with that many used slots, last: entries from the current search
+	std::array<uint64_t, bucket_size + 2> sum{};
+	std::mutex sum_mutex;
+
+	thread_pool().parallel_for(buckets_, [&](const size_t begin, const size_t end)
+		{
+			std::array<uint64_t, bucket_size + 2> c{};
+			for (auto b = begin; b < end; ++b)
+			{
+				auto used = 0;
+				for (const auto& e : hash_mem_[b].entry)
+					if (e.stored_key())
+					{
+						++used;
+						if (e.age() == age_)
+							++c[bucket_size + 1];
+					}
+				++c[used];
+			}
+
+			std::lock_guard lk(sum_mutex);
+			for (size_t i = 0; i < sum.size(); ++i)
+				sum[i] += c[i];
+		});
+
+	uint64_t used = 0;
+	for (auto i = 1; i <= bucket_size; ++i)
+		used += sum[i] * i;
+
+	const auto entries = static_cast<double>(buckets_ * bucket_size);
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(1)
+		<< "info string hashstats size " << (size() >> 20) << " MB buckets " << buckets_
+		<< " used " << 100.0 * static_cast<double>(used) / entries << "%"
+		<< " current " << 100.0 * static_cast<double>(sum[bucket_size + 1]) / entries << "%"
+		<< " slots";
+	for (auto i = 0; i <= bucket_size; ++i)
+		ss << " " << i << ":" << 100.0 * static_cast<double>(sum[i]) / static_cast<double>(buckets_) << "%";
+	return ss.str();
+}
+
 // send hash memory usage info to UCI GUI
-int hash::hash_full() const
+template <typename layout>
+int transposition_table<layout>::hash_full() const
 {
 	constexpr auto i_max = 999 / bucket_size + 1;
 	auto cnt = 0;
 	for (auto i = 0; i < i_max; i++)
 	{
-		const main_hash_entry* hash_entry = &hash_mem_[i].entry[0];
+		const entry_type* hash_entry = &hash_mem_[i].entry[0];
 		for (auto j = 0; j < bucket_size; j++)
-			if (hash_entry[j].key_ && (hash_entry[j].flags_ & age_mask) == age_)
+			if (hash_entry[j].stored_key() && hash_entry[j].age() == age_)
 				cnt++;
 	}
 	return cnt * 1000 / (i_max * bucket_size);
 }
+
+template class transposition_table<hash_layout>;
+
+void pv_hash::clear()
+{
+	std::memset(pv_hash_mem_, 0, sizeof pv_hash_mem_);
+}
+
+hash_counters& hash_counters::operator+=(const hash_counters& other)
+{
+	probes += other.probes;
+	hits += other.hits;
+	key_compares += other.key_compares;
+	replace_empty += other.replace_empty;
+	replace_same += other.replace_same;
+	replace_aged += other.replace_aged;
+	replace_shallow += other.replace_shallow;
+	save_new += other.save_new;
+	save_deeper += other.save_deeper;
+	save_exact += other.save_exact;
+	save_skipped += other.save_skipped;
+	q_probes += other.q_probes;
+	q_hits += other.q_hits;
+	return *this;
+}
+
+namespace hashstats
+{
+	namespace
+	{
+		std::mutex registry_mutex;
+		std::vector<local_counters*> registry;
+
+		// counts of threads that have already exited
+		hash_counters retired{};
+	}
+
+	local_counters::local_counters()
+	{
+		std::lock_guard lk(registry_mutex);
+		registry.push_back(this);
+	}
+
+	local_counters::~local_counters()
+	{
+		std::lock_guard lk(registry_mutex);
+		retired += counters;
+		registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+	}
+
+	hash_counters total()
+	{
+		std::lock_guard lk(registry_mutex);
+		auto sum = retired;
+		for (const auto* block : registry)
+			sum += block->counters;
+		return sum;
+	}
+
+	void clear()
+	{
+		std::lock_guard lk(registry_mutex);
+		retired = {};
+		for (auto* block : registry)
+			block->counters = {};
+	}
+
+	// one line summary; false positives are estimated from the number of occupied
+	// non-matching slots compared, each of which matches a key of n bits with p = 1/2^n
+	std::string info()
+	{
+		const auto hc = total();
+		const auto pct = [](const uint64_t part, const uint64_t whole)
+		{
+			return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+		};
+		constexpr auto key_bits = 8 * static_cast<int>(sizeof(main_hash_entry::key_bits(0)));
+		const auto replaced = hc.replace_empty + hc.replace_same + hc.replace_aged + hc.replace_shallow;
+
+		std::ostringstream ss;
+		ss << std::fixed << std::setprecision(1)
+			<< "info string hashstats probes " << hc.probes
+			<< " hits " << pct(hc.hits, hc.probes) << "%"
+			<< " misses " << pct(hc.probes - hc.hits, hc.probes) << "%"
+			<< " falsepos " << std::setprecision(0) << std::ldexp(static_cast<double>(hc.key_compares), -key_bits)
+			<< std::setprecision(1)
+			<< " replace empty " << pct(hc.replace_empty, replaced) << "%"
+			<< " same " << pct(hc.replace_same, replaced) << "%"
+			<< " aged " << pct(hc.replace_aged, replaced) << "%"
+			<< " shallow " << pct(hc.replace_shallow, replaced) << "%"
+			<< " save new " << hc.save_new
+			<< " deeper " << hc.save_deeper
+			<< " exact " << hc.save_exact
+			<< " skipped " << hc.save_skipped;
+		if (hc.q_probes)
+			ss << " qcache probes " << hc.q_probes << " hits " << pct(hc.q_hits, hc.q_probes) << "%";
+		return ss.str();
+	}
+
+	namespace
+	{
+		// stress test keys: the top 16 bits number the key, the low bits select one of a few buckets
+		// so that all threads fight over the same slots
+		constexpr int stress_keys = 64;
+		constexpr int stress_buckets = 4;
+
+		uint32_t stress_mix(uint32_t x)
+		{
+			x = (x ^ x >> 16) * 0x45d9f3b;
+			x = (x ^ x >> 16) * 0x45d9f3b;
+			return x ^ x >> 16;
+		}
+
+		uint64_t stress_key(const int i)
+		{
+			return static_cast<uint64_t>(i + 1) << 48
+				| static_cast<uint64_t>(stress_mix(i) & 0xfffffff) << 20
+				| static_cast<uint64_t>(i % stress_buckets) << 6;
+		}
+
+		// payload written for key i, so a reader can tell whether an entry holds parts of two positions
+		int stress_value(const int i)
+		{
+			return static_cast<int>(stress_mix(i + stress_keys) & 0x3fff) - 0x2000;
+		}
+
+		int stress_eval(const int i)
+		{
+			return static_cast<int>(stress_mix(i + 2 * stress_keys) & 0x3fff) - 0x2000;
+		}
+
+		uint32_t stress_move(const int i)
+		{
+			return stress_mix(i + 3 * stress_keys) & 0xffff;
+		}
+
+		struct stress_counts
+		{
+			uint64_t writes;
+			uint64_t probes;
+			uint64_t hits;
+			uint64_t accepted;
+			uint64_t detected;
+		};
+
+		// stored key bits that belong to none of the keys written: a torn entry caught by the key check
+		template <typename entry_type, typename key_type>
+		bool stress_foreign(const key_type stored)
+		{
+			const auto top = static_cast<uint64_t>(stored) << (64 - 8 * sizeof(key_type));
+			const auto i = static_cast<int>(top >> 48) - 1;
+			return i < 0 || i >= stress_keys || entry_type::key_bits(stress_key(i)) != stored;
+		}
+
+		// threads randomly write and probe the stress keys for the given time; a hit whose payload
+		// is not the one written for its key is corruption the layout accepted, a slot whose key is
+		// not one of the stress keys is corruption the layout detected
+		template <typename layout>
+		stress_counts stress_table(const int threads, const int seconds)
+		{
+			typedef typename layout::entry_type entry_type;
+
+			transposition_table<layout> table;
+			table.init(1);
+
+			std::atomic<bool> stop{false};
+			std::vector<stress_counts> counts(threads);
+			std::vector<std::thread> workers;
+
+			for (auto t = 0; t < threads; ++t)
+				workers.emplace_back([&table, &stop, &counts, t]()
+					{
+						auto& c = counts[t];
+						c = {};
+						uint64_t seed = 0x9e3779b97f4a7c15ull * (t + 1);
+
+						while (!stop.load(std::memory_order_relaxed))
+						{
+							seed ^= seed << 13;
+							seed ^= seed >> 7;
+							seed ^= seed << 17;
+							const auto i = static_cast<int>(seed % stress_keys);
+							const auto key = stress_key(i);
+
+							if (seed >> 63)
+							{
+								table.replace(key)->save(key, stress_value(i), exact_value, plies, stress_move(i),
+									stress_eval(i), table.age());
+								++c.writes;
+								continue;
+							}
+
+							// probed like the search does, so a hit is the snapshot the search would use
+							++c.probes;
+							entry_type found;
+							if (const auto* const e = table.probe(key, found))
+							{
+								++c.hits;
+								if (e->move() != stress_move(i) || e->value() != stress_value(i)
+									|| e->eval() != stress_eval(i))
+									++c.accepted;
+							}
+
+							const auto* slot = table.entry(key);
+							for (auto n = 0; n < layout::entries; ++n)
+							{
+								const auto copy = slot[n].snapshot();
+								if (copy.stored_key() && stress_foreign<entry_type>(copy.stored_key()))
+									++c.detected;
+							}
+						}
+					});
+
+			std::this_thread::sleep_for(std::chrono::seconds(seconds));
+			stop = true;
+			for (auto& w : workers)
+				w.join();
+
+			stress_counts sum{};
+			for (const auto& c : counts)
+			{
+				sum.writes += c.writes;
+				sum.probes += c.probes;
+				sum.hits += c.hits;
+				sum.accepted += c.accepted;
+				sum.detected += c.detected;
+			}
+			return sum;
+		}
+
+		template <typename layout>
+		void stress_report(const int threads, const int seconds)
+		{
+			const auto c = stress_table<layout>(threads, seconds);
+			acout() << "info string hashstress layout " << layout::name << " threads " << threads
+				<< " writes " << c.writes << " probes " << c.probes << " hits " << c.hits
+				<< " corrupt accepted " << c.accepted << " detected " << c.detected << std::endl;
+		}
+	}
+
+	// hammer a small table from many threads, comparing the build's layout with verified entries
+	void stress(const int threads, const int seconds)
+	{
+		stress_report<hash_layout>(threads, seconds);
+		if constexpr (!std::is_same_v<hash_layout, layout_xor>)
+			stress_report<layout_xor>(threads, seconds);
+	}
+}
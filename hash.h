@@ -15,8 +15,17 @@
 */
 
 #pragma once
+#include <atomic>
+#include <cstring>
+#include <string>
+
 #include "define.h"
 #include "fire.h"
+#include "numa.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
 
 enum hashflags : uint8_t
 {
@@ -34,7 +43,94 @@ constexpr uint8_t flags_mask = 0xc7;
 constexpr uint8_t threat_mask = 0x03;
 constexpr uint8_t use_mask = 0xfb;
 
-struct main_hash_entry
+// how the transposition table memory was obtained from the OS
+enum hashmemory : uint8_t
+{
+	mem_none,
+	mem_huge_1g,
+	mem_huge_2m,
+	mem_transparent,
+	mem_standard,
+	mem_file,
+	mem_shared
+};
+
+// deepest root iteration completed by any process sharing the table, for one root position
+struct sharedroot
+{
+	uint64_t key;
+	int depth;
+	int score;
+	uint32_t move;
+};
+
+// most processes that can attach to one shared memory hash segment
+constexpr int shared_processes_max = 64;
+
+// first page of a shared memory hash segment: the table geometry checked by attaching processes,
+// the pids of the processes attached, the search age they share and the best root result.
+// pids and root are guarded by a robust process-shared mutex, and a pid whose process has exited
+// no longer counts, so a process that crashes does not block or keep alive the others
+struct sharedcontrol
+{
+	uint32_t layout;
+	uint32_t bucket_size;
+	uint64_t buckets;
+	std::atomic<uint32_t> ready;
+	std::atomic<uint8_t> age;
+#ifdef __linux__
+	pthread_mutex_t lock;
+#endif
+	int32_t pids[shared_processes_max];
+	sharedroot root;
+};
+
+// per-thread transposition table counters, only updated when use_hash_stats is set
+struct hash_counters
+{
+	uint64_t probes;
+	uint64_t hits;
+	uint64_t key_compares;
+	uint64_t replace_empty;
+	uint64_t replace_same;
+	uint64_t replace_aged;
+	uint64_t replace_shallow;
+	uint64_t save_new;
+	uint64_t save_deeper;
+	uint64_t save_exact;
+	uint64_t save_skipped;
+	uint64_t q_probes;
+	uint64_t q_hits;
+
+	hash_counters& operator+=(const hash_counters& other);
+};
+
+namespace hashstats
+{
+	// each thread counts into its own block, registered so the blocks can be summed
+	struct local_counters
+	{
+		local_counters();
+		~local_counters();
+		hash_counters counters{};
+	};
+
+	inline thread_local local_counters local_block;
+
+	inline hash_counters& local()
+	{
+		return local_block.counters;
+	}
+
+	hash_counters total();
+	void clear();
+	std::string info();
+	void stress(int threads, int seconds);
+}
+
+// transposition table entry; key_type holds the upper bits of the position key
+template <typename key_type>
+struct hash_entry
 {
 	[[nodiscard]] uint32_t move() const
 	{
@@ -66,18 +162,62 @@ struct main_hash_entry
 		return static_cast<hashflags>(flags_ & threat_mask);
 	}
 
+	static key_type key_bits(const uint64_t k)
+	{
+		return static_cast<key_type>(k >> (64 - 8 * sizeof(key_type)));
+	}
+
+	[[nodiscard]] key_type stored_key() const
+	{
+		return key_;
+	}
+
+	[[nodiscard]] int stored_depth() const
+	{
+		return depth_;
+	}
+
+	[[nodiscard]] uint8_t age() const
+	{
+		return flags_ & age_mask;
+	}
+
+	[[nodiscard]] hash_entry snapshot() const
+	{
+		return *this;
+	}
+
+	void set_age(const key_type k, const uint8_t gen)
+	{
+		if (key_ == k)
+			flags_ = static_cast<uint8_t>(gen + (flags_ & flags_mask));
+	}
+
 	void save(const uint64_t k, const int val, const uint8_t flags, const int d, const uint32_t z, const int eval, const uint8_t gen)
 	{
 		const auto dd = d / plies;
-		const uint16_t k16 = k >> 48;
-		if (z || k16 != key_)
+		const auto kk = key_bits(k);
+		if (z || kk != key_)
 			move_ = static_cast<uint16_t>(z);
 
-		if (k16 != key_
+		if constexpr (use_hash_stats)
+		{
+			auto& hs = hashstats::local();
+			if (kk != key_)
+				++hs.save_new;
+			else if ((flags & exact_value) == exact_value)
+				++hs.save_exact;
+			else if (dd > depth_ - 4)
+				++hs.save_deeper;
+			else
+				++hs.save_skipped;
+		}
+
+		if (kk != key_
 			|| dd > depth_ - 4
 			|| (flags & exact_value) == exact_value)
 		{
-			key_ = k16;
+			key_ = kk;
 			value_ = static_cast<int16_t>(val);
 			eval_ = static_cast<int16_t>(eval);
 			flags_ = static_cast<uint8_t>(gen + flags);
@@ -86,9 +226,7 @@ struct main_hash_entry
 	}
 
 private:
-	friend class hash;
-
-	uint16_t key_;
+	key_type key_;
 	int8_t depth_;
 	uint8_t flags_;
 	int16_t value_;
@@ -96,43 +234,272 @@ private:
 	uint16_t move_;
 };
 
-class hash
+// lockless hashing entry: the payload is packed into one word and the key is stored xor-ed with it,
+// so an entry torn by threads writing it at the same time fails the key check and reads as a miss.
+// the check only holds for a copy: readers verify and decode a snapshot, and writers build the new
+// words from a snapshot too, so a torn entry is never rewritten with a valid check word
+struct verified_entry
+{
+	[[nodiscard]] uint32_t move() const
+	{
+		return static_cast<uint16_t>(data_);
+	}
+
+	[[nodiscard]] int value() const
+	{
+		return static_cast<int16_t>(data_ >> 16);
+	}
+
+	[[nodiscard]] int eval() const
+	{
+		return static_cast<int16_t>(data_ >> 32);
+	}
+
+	[[nodiscard]] int depth() const
+	{
+		return stored_depth() * static_cast<int>(plies) + plies - 1;
+	}
+
+	[[nodiscard]] hashflags bounds() const
+	{
+		return static_cast<hashflags>(flags() & exact_value);
+	}
+
+	[[nodiscard]] hashflags threat() const
+	{
+		return static_cast<hashflags>(flags() & threat_mask);
+	}
+
+	static uint64_t key_bits(const uint64_t k)
+	{
+		return k;
+	}
+
+	[[nodiscard]] uint64_t stored_key() const
+	{
+		return check_ ^ data_;
+	}
+
+	[[nodiscard]] int stored_depth() const
+	{
+		return static_cast<int8_t>(data_ >> 48);
+	}
+
+	[[nodiscard]] uint8_t age() const
+	{
+		return flags() & age_mask;
+	}
+
+	// both words loaded once; a torn copy has a stored key that matches no position
+	[[nodiscard]] verified_entry snapshot() const
+	{
+		verified_entry copy;
+		copy.check_ = *static_cast<const volatile uint64_t*>(&check_);
+		copy.data_ = *static_cast<const volatile uint64_t*>(&data_);
+		return copy;
+	}
+
+	void set_age(const uint64_t k, const uint8_t gen)
+	{
+		if (const auto seen = snapshot(); seen.stored_key() == k)
+			write(k, seen.move(), seen.value(), seen.eval(), seen.stored_depth(),
+				static_cast<uint8_t>(gen + (seen.flags() & flags_mask)));
+	}
+
+	void save(const uint64_t k, const int val, const uint8_t flags, const int d, const uint32_t z, const int eval, const uint8_t gen)
+	{
+		const auto dd = d / plies;
+		const auto seen = snapshot();
+		const auto same = seen.stored_key() == k;
+		const auto m = z || !same ? z : seen.move();
+
+		if constexpr (use_hash_stats)
+		{
+			auto& hs = hashstats::local();
+			if (!same)
+				++hs.save_new;
+			else if ((flags & exact_value) == exact_value)
+				++hs.save_exact;
+			else if (dd > seen.stored_depth() - 4)
+				++hs.save_deeper;
+			else
+				++hs.save_skipped;
+		}
+
+		if (!same
+			|| dd > seen.stored_depth() - 4
+			|| (flags & exact_value) == exact_value)
+			write(k, m, val, eval, dd, static_cast<uint8_t>(gen + flags));
+		else if (m != seen.move())
+			write(k, m, seen.value(), seen.eval(), seen.stored_depth(), seen.flags());
+	}
+
+private:
+	[[nodiscard]] uint8_t flags() const
+	{
+		return static_cast<uint8_t>(data_ >> 56);
+	}
+
+	void write(const uint64_t k, const uint32_t m, const int val, const int eval, const int dd, const uint8_t flags)
+	{
+		const auto data = static_cast<uint64_t>(static_cast<uint16_t>(m))
+			| static_cast<uint64_t>(static_cast<uint16_t>(val)) << 16
+			| static_cast<uint64_t>(static_cast<uint16_t>(eval)) << 32
+			| static_cast<uint64_t>(static_cast<uint8_t>(dd)) << 48
+			| static_cast<uint64_t>(flags) << 56;
+		*static_cast<volatile uint64_t*>(&check_) = k ^ data;
+		*static_cast<volatile uint64_t*>(&data_) = data;
+	}
+
+	uint64_t check_;
+	uint64_t data_;
+};
+
+// bucket layouts, selected at build time with 'make hashlayout=...'
+// entries: slots per bucket, bytes: bucket size, depth_slot: slot 0 keeps the deepest entry
+// and only the remaining slots are replaced, id: stored in saved hash files
+
+// 3 x 10-byte entries with 16-bit keys in a 32-byte bucket (default)
+struct layout_3x16
+{
+	typedef hash_entry<uint16_t> entry_type;
+	static constexpr int entries = 3;
+	static constexpr size_t bytes = 32;
+	static constexpr bool depth_slot = false;
+	static constexpr uint32_t id = 0;
+	static constexpr auto name = "3x16";
+};
+
+// 4 x 12-byte entries with 32-bit keys in a 64-byte bucket
+struct layout_4x32
 {
+	typedef hash_entry<uint32_t> entry_type;
+	static constexpr int entries = 4;
+	static constexpr size_t bytes = 64;
+	static constexpr bool depth_slot = false;
+	static constexpr uint32_t id = 1;
+	static constexpr auto name = "4x32";
+};
+
+// 2 x 16-byte entries with full 64-bit keys in a 32-byte bucket
+struct layout_2x64
+{
+	typedef hash_entry<uint64_t> entry_type;
+	static constexpr int entries = 2;
+	static constexpr size_t bytes = 32;
+	static constexpr bool depth_slot = false;
+	static constexpr uint32_t id = 2;
+	static constexpr auto name = "2x64";
+};
+
+// 3 x 10-byte entries with 16-bit keys: slot 0 depth-preferred, slots 1-2 always-replace
+struct layout_split
+{
+	typedef hash_entry<uint16_t> entry_type;
+	static constexpr int entries = 3;
+	static constexpr size_t bytes = 32;
+	static constexpr bool depth_slot = true;
+	static constexpr uint32_t id = 3;
+	static constexpr auto name = "split";
+};
+
+// 4 x 16-byte verified entries with full 64-bit keys in a 64-byte bucket
+struct layout_xor
+{
+	typedef verified_entry entry_type;
+	static constexpr int entries = 4;
+	static constexpr size_t bytes = 64;
+	static constexpr bool depth_slot = false;
+	static constexpr uint32_t id = 4;
+	static constexpr auto name = "xor";
+};
+
+#if defined(HASH_LAYOUT_4X32)
+typedef layout_4x32 hash_layout;
+#elif defined(HASH_LAYOUT_2X64)
+typedef layout_2x64 hash_layout;
+#elif defined(HASH_LAYOUT_SPLIT)
+typedef layout_split hash_layout;
+#elif defined(HASH_LAYOUT_XOR)
+typedef layout_xor hash_layout;
+#else
+typedef layout_3x16 hash_layout;
+#endif
+
+typedef hash_layout::entry_type main_hash_entry;
+
+template <typename layout>
+class transposition_table
+{
+	typedef typename layout::entry_type entry_type;
+
 	static constexpr int cache_line = 64;
-	static constexpr int bucket_size = 3;
+	static constexpr int bucket_size = layout::entries;
 
-	struct bucket
+	struct alignas(layout::bytes) bucket
 	{
-		main_hash_entry entry[bucket_size];
-		char padding[2];
+		entry_type entry[bucket_size];
 	};
 
-	static_assert(cache_line % sizeof(bucket) == 0, "Cluster size incorrect");
+	static_assert(sizeof(bucket) == layout::bytes && cache_line % sizeof(bucket) == 0, "Cluster size incorrect");
 
 public:
-	~hash()
+	~transposition_table()
 	{
-		free(hash_mem_);
+		release();
 	}
 
-	void new_age()
-	{
-		age_ = age_ + 8 & age_mask;
-	}
+	void new_age();
 
 	[[nodiscard]] uint8_t age() const
 	{
 		return age_;
 	}
-	[[nodiscard]] main_hash_entry* probe(uint64_t key) const;
-	[[nodiscard]] main_hash_entry* replace(uint64_t key) const;
+	[[nodiscard]] const entry_type* probe(uint64_t key, entry_type& found) const;
+	[[nodiscard]] entry_type* replace(uint64_t key) const;
 	[[nodiscard]] int hash_full() const;
+	[[nodiscard]] std::string occupancy() const;
 	void init(size_t mb_size);
-	void clear() const;
+	void resize(size_t mb_size);
+	bool clear() const;
+	void large_pages(bool enable);
+	void numa_policy(numapolicy policy);
+	[[nodiscard]] bool save(const std::string& file_name) const;
+	[[nodiscard]] bool load(const std::string& file_name);
+	[[nodiscard]] bool share(const std::string& name, size_t mb_size);
+	void publish_root(const sharedroot& result) const;
+	[[nodiscard]] bool shared_root(uint64_t key, sharedroot& result) const;
+
+	[[nodiscard]] bool shared() const
+	{
+		return control_ != nullptr;
+	}
+
+	[[nodiscard]] int shared_processes() const;
+
+	[[nodiscard]] hashmemory memory_type() const
+	{
+		return mem_type_;
+	}
+
+	[[nodiscard]] size_t size() const
+	{
+		return buckets_ * sizeof(bucket);
+	}
+
+	[[nodiscard]] numapolicy numa_policy() const
+	{
+		return numa_policy_;
+	}
+
+	[[nodiscard]] static const char* layout_name()
+	{
+		return layout::name;
+	}
 
-	[[nodiscard]] inline main_hash_entry* entry(const uint64_t key) const
+	[[nodiscard]] inline entry_type* entry(const uint64_t key) const
 	{
-		return reinterpret_cast<main_hash_entry*>(reinterpret_cast<char*>(hash_mem_) + (key & bucket_mask_));
+		return reinterpret_cast<entry_type*>(reinterpret_cast<char*>(hash_mem_) + (key & bucket_mask_));
 	}
 
 	inline void prefetch_entry(const uint64_t key) const
@@ -141,10 +508,168 @@ public:
 	}
 
 private:
+	void* allocate(size_t size);
+	void release();
+	bool attach(const std::string& name, size_t mb_size);
+	void rebuild(size_t new_buckets);
+	void merge(bucket& target, const bucket* source, size_t stride, size_t count) const;
+
+	// replacement value of an entry: its depth, less the number of searches since it was last used
+	[[nodiscard]] int priority(const entry_type& e) const
+	{
+		return e.stored_depth() - (age_ - e.age() & age_mask);
+	}
+
 	size_t buckets_ = 0;
 	size_t bucket_mask_ = 0;
 	bucket* hash_mem_ = nullptr;
+	size_t mem_size_ = 0;
+	hashmemory mem_type_ = mem_none;
+	bool large_pages_ = true;
+	numapolicy numa_policy_ = numa_off;
 	uint8_t age_ = 0;
+	sharedcontrol* control_ = nullptr;
+	std::string shared_name_;
+};
+
+typedef transposition_table<hash_layout> hash;
+
+// small table holding only the best moves of exact PV nodes, so the PV and ponder move can still be
+// rebuilt when main_hash entries along the PV have been replaced. entries are xor-verified like
+// verified_entry, since helper threads store into it concurrently, and carry the search they were
+// stored in: a move from an earlier search or game is never preferred over the main hash
+class pv_hash
+{
+	struct pv_entry
+	{
+		uint64_t check;
+		uint64_t move;
+	};
+
+public:
+	[[nodiscard]] uint32_t probe(const uint64_t key) const
+	{
+		const auto& e = pv_hash_mem_[key & (pv_hash_size - 1)];
+		const auto check = e.check;
+		const auto move = e.move;
+		return (check ^ move) == key && static_cast<uint32_t>(move >> 32) == age_ ? static_cast<uint32_t>(move) : no_move;
+	}
+
+	void save(const uint64_t key, const uint32_t move)
+	{
+		auto& e = pv_hash_mem_[key & (pv_hash_size - 1)];
+		const auto word = static_cast<uint64_t>(age_) << 32 | move;
+		e.check = key ^ word;
+		e.move = word;
+	}
+
+	// called when a search starts, so the entries of earlier searches no longer match
+	void new_age()
+	{
+		++age_;
+	}
+
+	void clear();
+
+private:
+	uint32_t age_ = 0;
+
+	// 16384 entries = 256 KB
+	static constexpr int pv_hash_size = 16384;
+	CACHE_ALIGN pv_entry pv_hash_mem_[pv_hash_size];
+};
+
+class thread;
+
+// moves currently being searched by some thread, keyed by position and move, for the abdada smp mode.
+// a thread marks the move it descends into, so the other threads can defer that move and search their
+// remaining moves first. one slot per key; when the slot is held by another move the move is not marked
+class busy_hash
+{
+	struct busy_entry
+	{
+		std::atomic<uint64_t> key;
+		std::atomic<const thread*> owner;
+	};
+
+public:
+	[[nodiscard]] static uint64_t move_key(const uint64_t key, const uint32_t move)
+	{
+		return key ^ static_cast<uint64_t>(move) * 0x9e3779b97f4a7c15ull;
+	}
+
+	[[nodiscard]] bool busy(const uint64_t key, const thread* th) const
+	{
+		const auto& e = busy_hash_mem_[key & (busy_hash_size - 1)];
+		const auto* owner = e.owner.load(std::memory_order_relaxed);
+		return owner && owner != th && e.key.load(std::memory_order_relaxed) == key;
+	}
+
+	// mark key as being searched by th, false if the slot is taken
+	bool enter(const uint64_t key, const thread* th)
+	{
+		auto& e = busy_hash_mem_[key & (busy_hash_size - 1)];
+		const thread* expected = nullptr;
+		if (!e.owner.compare_exchange_strong(expected, th, std::memory_order_acquire))
+			return false;
+		e.key.store(key, std::memory_order_relaxed);
+		return true;
+	}
+
+	void leave(const uint64_t key)
+	{
+		auto& e = busy_hash_mem_[key & (busy_hash_size - 1)];
+		e.key.store(0, std::memory_order_relaxed);
+		e.owner.store(nullptr, std::memory_order_release);
+	}
+
+private:
+	// 4096 entries = 64 KB
+	static constexpr int busy_hash_size = 4096;
+	CACHE_ALIGN busy_entry busy_hash_mem_[busy_hash_size];
 };
 
-extern hash main_hash;
+// per-thread cache for q_search entries, so the shallow quiescence stores stay out of main_hash
+// and off the cache lines it shares between threads. direct mapped, every store replaces the slot
+template <int Size>
+struct q_search_hash_table
+{
+	[[nodiscard]] const main_hash_entry* probe(const uint64_t key, main_hash_entry& found)
+	{
+		found = entry(key)->snapshot();
+
+		if constexpr (use_hash_stats)
+			++hashstats::local().q_probes;
+
+		if (found.stored_key() != main_hash_entry::key_bits(key))
+			return nullptr;
+
+		if constexpr (use_hash_stats)
+			++hashstats::local().q_hits;
+
+		return &found;
+	}
+
+	[[nodiscard]] main_hash_entry* replace(const uint64_t key)
+	{
+		return entry(key);
+	}
+
+	void clear()
+	{
+		std::memset(q_hash_mem_, 0, sizeof q_hash_mem_);
+	}
+
+private:
+	main_hash_entry* entry(const uint64_t key)
+	{
+		return &q_hash_mem_[key & (Size - 1)];
+	}
+
+	CACHE_ALIGN main_hash_entry q_hash_mem_[Size];
+};
+
+// 16384 entries = 160 KB (256 KB with 16-byte entries), sized to stay in L2
+constexpr int q_search_hash_size = 16384;
+
+typedef q_search_hash_table<q_search_hash_size> q_search_hash;
@@ -0,0 +1,448 @@
+/*
+  Fire is a freeware UCI chess playing engine authored by Norman Schmidt.
+
+  Fire utilizes many state-of-the-art chess programming ideas and techniques
+  which have been documented in detail at https://www.chessprogramming.org/
+  and demonstrated via the very strong open-source chess engine Stockfish...
+  https://github.com/official-stockfish/Stockfish.
+
+  Fire is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or any later version.
+
+  You should have received a copy of the GNU General Public License with
+  this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mate.h"
+
+#include <algorithm>
+
+#include "engine.h"
+#include "movegen.h"
+#include "position.h"
+#include "thread.h"
+#include "uci.h"
+#include "util/util.h"
+
+namespace mate
+{
+	void mate_hash::init(const size_t mb_size)
+	{
+		auto count = (mb_size << 20) / sizeof(bucket);
+		while (count & (count - 1))
+			count &= count - 1;
+
+		buckets_.assign(std::max(count, static_cast<size_t>(1)), bucket{});
+	}
+
+	void mate_hash::clear()
+	{
+		std::fill(buckets_.begin(), buckets_.end(), bucket{});
+	}
+
+	// an entry of the same plies, or a proof found with fewer plies, or a disproof found with more
+	bool mate_hash::probe(const uint64_t key, const int remaining, mate_entry& found)
+	{
+		const auto index = key & (buckets_.size() - 1);
+		std::lock_guard lk(locks_[index & (lock_count - 1)]);
+
+		for (const auto& e : buckets_[index].entry)
+			if (e.key == key && (e.remaining == remaining
+				|| e.pn == 0 && e.remaining <= remaining
+				|| e.dn == 0 && e.remaining >= remaining))
+			{
+				found = e;
+				return true;
+			}
+
+		return false;
+	}
+
+	// overwrite the entry of the same plies or one the new result supersedes, else the entry with the least work
+	void mate_hash::save(const uint64_t key, const int remaining, const uint32_t pn, const uint32_t dn, const uint32_t move,
+		const uint64_t work)
+	{
+		const auto index = key & (buckets_.size() - 1);
+		std::lock_guard lk(locks_[index & (lock_count - 1)]);
+
+		auto* replace = &buckets_[index].entry[0];
+		for (auto& e : buckets_[index].entry)
+		{
+			if (e.key == key && (e.remaining == remaining
+				|| pn == 0 && e.pn == 0 && e.remaining >= remaining
+				|| dn == 0 && e.dn == 0 && e.remaining <= remaining))
+			{
+				replace = &e;
+				break;
+			}
+			if (e.work < replace->work)
+				replace = &e;
+		}
+
+		*replace = {key, pn, dn, move, static_cast<uint32_t>(std::min(work, static_cast<uint64_t>(UINT32_MAX))),
+			static_cast<int16_t>(remaining), 0, 0};
+	}
+
+	namespace
+	{
+		struct child
+		{
+			uint32_t move;
+			uint32_t phi;
+			uint32_t delta;
+			uint64_t key;
+		};
+
+		// one thread's search of the root for one mate length
+		struct context
+		{
+			thread* th;
+			int moves;
+			int index;
+			bool busy_marks;
+
+			[[nodiscard]] bool stopped() const
+			{
+				auto& s = mate_solver();
+				return search::signals().stop_analyzing.load(std::memory_order_relaxed)
+					|| s.result.load(std::memory_order_relaxed) != solve_running
+					|| s.moves.load(std::memory_order_relaxed) != moves
+					|| th->root_position->visited_nodes() >= th->node_quota && !thread_pool().claim_nodes(th);
+			}
+		};
+
+		// legal moves of the side to move. with one ply left the attacker has to mate, so only
+		// checks are generated: captures and queen promotions that check, and the quiet checks
+		int generate(const position& pos, s_move* moves, const bool attacker, const int remaining)
+		{
+			const auto checks_only = attacker && remaining == 1;
+			auto* end = pos.is_in_check()
+				? generate_moves<evade_check>(pos, moves)
+				: checks_only
+				? generate_moves<quiet_checks>(pos, generate_moves<captures_promotions>(pos, moves))
+				: generate_moves<all_moves>(pos, moves);
+
+			const auto pinned = pos.pinned_pieces();
+			const auto square_k = pos.king(pos.on_move());
+			auto* last = moves;
+			for (auto* p_move = moves; p_move != end; ++p_move)
+			{
+				if ((pinned || from_square(*p_move) == square_k || move_type(*p_move) == enpassant)
+					&& !pos.legal_move(*p_move))
+					continue;
+				if (checks_only && !pos.give_check(*p_move))
+					continue;
+				*last++ = *p_move;
+			}
+			return static_cast<int>(last - moves);
+		}
+
+		// phi and delta are the proof numbers seen from the side to move: phi is the cost of reaching its
+		// goal, delta of refuting it. (infinite, 0) means the side to move failed, (0, infinite) it succeeded
+		void to_pn_dn(const bool attacker, const uint32_t phi, const uint32_t delta, uint32_t& pn, uint32_t& dn)
+		{
+			pn = attacker ? phi : delta;
+			dn = attacker ? delta : phi;
+		}
+
+		bool lookup(const uint64_t key, const bool attacker, const int remaining, uint32_t& phi, uint32_t& delta)
+		{
+			mate_hash::mate_entry e{};
+			if (!mate_solver().table.probe(key, remaining, e))
+				return false;
+
+			phi = attacker ? e.pn : e.dn;
+			delta = attacker ? e.dn : e.pn;
+			return true;
+		}
+
+		void no_moves(const position& pos, const bool attacker, uint32_t& phi, uint32_t& delta)
+		{
+			const auto lost = attacker || pos.is_in_check();
+			phi = lost ? infinite : 0;
+			delta = lost ? 0 : infinite;
+		}
+
+		// a new node is valued by its number of moves (df-pn+ style). a side without moves has lost when in check,
+		// a stalemated defender has escaped, and so has a defender that is not mated when the plies run out
+		void initial(const position& pos, const bool attacker, const int remaining, uint32_t& phi, uint32_t& delta)
+		{
+			if (!attacker && remaining == 0)
+			{
+				const auto mated = pos.is_in_check() && !at_least_one_legal_move(pos);
+				phi = mated ? infinite : 0;
+				delta = mated ? 0 : infinite;
+				return;
+			}
+
+			s_move moves[max_moves];
+			if (const auto number = generate(pos, moves, attacker, remaining); number == 0)
+				no_moves(pos, attacker, phi, delta);
+			else
+			{
+				phi = 1;
+				delta = static_cast<uint32_t>(number);
+			}
+		}
+
+		// multiple iterative deepening: search the node until its phi or delta reaches the thresholds.
+		// the child with the smallest delta is searched with thresholds that return as soon as another
+		// child becomes the better choice, widened by 1 + epsilon to return less often (and more widely
+		// for the helpers, so the threads spread over the tree). returns the nodes searched
+		uint64_t mid(position& pos, context& cx, const uint32_t th_phi, const uint32_t th_delta, const bool attacker,
+			const int remaining, const rootmoves* root, uint32_t& phi, uint32_t& delta)
+		{
+			s_move moves[max_moves];
+			child children[max_moves];
+			auto number = 0;
+
+			if (root)
+			{
+				for (auto i = 0; i < root->move_number; ++i)
+					if (remaining > 1 || pos.give_check((*root)[i].pv[0]))
+						moves[number++] = (*root)[i].pv[0];
+			}
+			else
+				number = generate(pos, moves, attacker, remaining);
+
+			const auto key = pos.key();
+			uint32_t pn, dn;
+
+			if (number == 0 || !attacker && remaining == 0)
+			{
+				if (number == 0)
+					no_moves(pos, attacker, phi, delta);
+				else
+					initial(pos, attacker, remaining, phi, delta);
+				to_pn_dn(attacker, phi, delta, pn, dn);
+				mate_solver().table.save(key, remaining, pn, dn, no_move, 1);
+				return 1;
+			}
+
+			uint64_t work = 1;
+			for (auto i = 0; i < number; ++i)
+			{
+				auto& c = children[i];
+				c.move = moves[i];
+				pos.play_move(c.move);
+				c.key = pos.key();
+				if (!lookup(c.key, !attacker, remaining - 1, c.phi, c.delta))
+				{
+					initial(pos, !attacker, remaining - 1, c.phi, c.delta);
+					to_pn_dn(!attacker, c.phi, c.delta, pn, dn);
+					mate_solver().table.save(c.key, remaining - 1, pn, dn, no_move, 0);
+				}
+				pos.take_move_back(c.move);
+				++work;
+			}
+
+			while (true)
+			{
+				// first: the child with the smallest delta. best: the one chosen, which for the
+				// helpers passes over children another thread is searching
+				auto first = 0, best = 0;
+				uint64_t sum = 0, second_delta = infinite, best_rank = UINT64_MAX, second_rank = infinite;
+				auto child_lost = false;
+
+				for (auto i = 0; i < number; ++i)
+				{
+					auto& c = children[i];
+					lookup(c.key, !attacker, remaining - 1, c.phi, c.delta);
+
+					sum += c.phi;
+					child_lost |= c.phi >= infinite;
+
+					if (i == 0 || c.delta < children[first].delta)
+					{
+						if (i)
+							second_delta = children[first].delta;
+						first = i;
+					}
+					else if (c.delta < second_delta)
+						second_delta = c.delta;
+
+					uint64_t rank = c.delta;
+					if (cx.busy_marks && busy_table().busy(busy_hash::move_key(key, c.move), cx.th))
+						rank = rank * 2 + 1;
+
+					if (rank < best_rank)
+					{
+						second_rank = best_rank;
+						best_rank = rank;
+						best = i;
+					}
+					else if (rank < second_rank)
+						second_rank = rank;
+				}
+
+				phi = children[first].delta;
+				delta = child_lost ? infinite : static_cast<uint32_t>(std::min(sum, static_cast<uint64_t>(infinite - 1)));
+
+				to_pn_dn(attacker, phi, delta, pn, dn);
+				if (!root || search::param().search_moves.empty())
+					mate_solver().table.save(key, remaining, pn, dn, children[first].move, work);
+
+				if (phi >= th_phi || delta >= th_delta || cx.stopped())
+					return work;
+
+				// 1 + epsilon: a quarter for the main thread, up to one for the helpers
+				const auto widen = [&](const uint64_t second)
+				{
+					return static_cast<uint32_t>(std::min(static_cast<uint64_t>(th_phi),
+						std::min(second, static_cast<uint64_t>(infinite)) * (5 + (cx.index & 3)) / 4 + 1));
+				};
+
+				auto c_th_delta = widen(second_rank);
+				if (children[best].delta >= c_th_delta)
+				{
+					best = first;
+					c_th_delta = widen(second_delta);
+				}
+
+				auto& c = children[best];
+				const auto c_th_phi = th_delta >= infinite ? infinite : th_delta - delta + c.phi;
+
+				const auto busy_key = busy_hash::move_key(key, c.move);
+				const auto busy_marked = cx.busy_marks && busy_table().enter(busy_key, cx.th);
+
+				pos.play_move(c.move);
+				work += mid(pos, cx, c_th_phi, c_th_delta, !attacker, remaining - 1, nullptr, c.phi, c.delta);
+				pos.take_move_back(c.move);
+
+				if (busy_marked)
+					busy_table().leave(busy_key);
+			}
+		}
+
+		// follow the proof: the attacker's move proven with the fewest plies, the defender's with the most
+		void proof_line(position& pos, int remaining, principal_variation& pv)
+		{
+			auto attacker = true;
+			while (remaining > 0 && pv.size() < max_pv)
+			{
+				s_move moves[max_moves];
+				const auto number = generate(pos, moves, attacker, remaining);
+				auto best = no_move;
+				auto best_remaining = attacker ? INT32_MAX : -1;
+
+				for (auto i = 0; i < number; ++i)
+				{
+					mate_hash::mate_entry e{};
+					pos.play_move(moves[i]);
+					const auto proven = mate_solver().table.probe(pos.key(), remaining - 1, e) && e.pn == 0;
+					pos.take_move_back(moves[i]);
+
+					if (!proven)
+					{
+						if (attacker)
+							continue;
+						best = no_move;
+						break;
+					}
+
+					if (attacker ? e.remaining < best_remaining : e.remaining > best_remaining)
+					{
+						best = moves[i];
+						best_remaining = e.remaining;
+					}
+				}
+
+				if (best == no_move)
+					break;
+
+				pv.add(best);
+				pos.play_move(best);
+				attacker = !attacker;
+				--remaining;
+			}
+
+			for (auto i = pv.size(); i > 0;)
+				pos.take_move_back(pv[--i]);
+		}
+	}
+
+	// start a 'go mate' search: the threads begin with mate in 1, the table is kept from earlier searches
+	void begin(const int mate_moves)
+	{
+		auto& s = mate_solver();
+		if (s.table.size() != static_cast<size_t>(uci_mate_hash) << 20)
+			s.table.init(uci_mate_hash);
+
+		s.limit = mate_moves;
+		s.moves = 1;
+		s.result = solve_running;
+	}
+
+	// run by every thread of the pool. true when a mate was found, then the main thread has put the mating
+	// move and its line in root_moves[0]; false when there is no mate within the limit or the search was stopped
+	bool solve(thread& th)
+	{
+		auto& s = mate_solver();
+		auto& pos = *th.root_position;
+		const auto main_thread = &th == thread_pool().main();
+		context cx{&th, 0, th.index(), thread_pool().active_thread_count > 1};
+
+		while (s.result == solve_running && !search::signals().stop_analyzing)
+		{
+			cx.moves = s.moves;
+			uint32_t phi, delta;
+			mid(pos, cx, infinite, infinite, true, 2 * cx.moves - 1, &th.root_moves, phi, delta);
+
+			if (phi == 0)
+			{
+				auto running = static_cast<int>(solve_running);
+				s.result.compare_exchange_strong(running, solve_mate);
+			}
+			else if (delta == 0)
+			{
+				if (main_thread && !bench_active)
+					acout() << "info depth " << 2 * cx.moves - 1 << " nodes " << thread_pool().visited_nodes()
+					<< " time " << time_control().elapsed() << std::endl;
+
+				if (cx.moves >= s.limit)
+				{
+					auto running = static_cast<int>(solve_running);
+					s.result.compare_exchange_strong(running, solve_no_mate);
+				}
+				else
+				{
+					auto moves = cx.moves;
+					s.moves.compare_exchange_strong(moves, cx.moves + 1);
+				}
+			}
+		}
+
+		if (!main_thread)
+			return s.result == solve_mate;
+
+		if (s.result == solve_no_mate)
+		{
+			if (!bench_active)
+				acout() << "info string no mate in " << s.limit << " found by the mate solver, searching on" << std::endl;
+			return false;
+		}
+
+		if (s.result != solve_mate)
+			return false;
+
+		const auto moves = s.moves.load();
+		principal_variation pv;
+		pv.move_number = 0;
+		proof_line(pos, 2 * moves - 1, pv);
+
+		const auto index = pv.size() ? th.root_moves.find(pv[0]) : -1;
+		if (index < 0)
+			return false;
+
+		auto& best = th.root_moves[0];
+		std::swap(best, th.root_moves[index]);
+		best.pv = pv;
+		best.score = gives_mate(2 * moves);
+		best.depth = (2 * moves - 1) * main_thread_inc;
+		th.completed_depth = best.depth;
+
+		search::signals().stop_analyzing = true;
+		return true;
+	}
+}
@@ -0,0 +1,96 @@
+/*
+  Fire is a freeware UCI chess playing engine authored by Norman Schmidt.
+
+  Fire utilizes many state-of-the-art chess programming ideas and techniques
+  which have been documented in detail at https://www.chessprogramming.org/
+  and demonstrated via the very strong open-source chess engine Stockfish...
+  https://github.com/official-stockfish/Stockfish.
+
+  Fire is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or any later version.
+
+  You should have received a copy of the GNU General Public License with
+  this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <atomic>
+#include <vector>
+
+#include "define.h"
+#include "fire.h"
+#include "mutex.h"
+
+class thread;
+
+// depth-first proof-number (df-pn) mate solver for 'go mate n'. the side to move is the attacker: a node
+// is proven when the attacker mates within the remaining plies, disproven when the defender escapes or
+// the plies run out. the plies strictly decrease along every path, so the search graph has no cycles
+namespace mate
+{
+	// proof and disproof numbers saturate below infinite, which proves or disproves a node
+	constexpr uint32_t infinite = 1u << 30;
+
+	// the longest mate the solver looks for, longer limits are left to the regular search
+	constexpr int max_mate_moves = 30;
+
+	// proof and disproof numbers of (position, remaining plies), shared by the solver threads. a proof
+	// also holds with more plies remaining and a disproof with fewer, so those are found for any budget
+	class mate_hash
+	{
+	public:
+		struct mate_entry
+		{
+			uint64_t key;
+			uint32_t pn;
+			uint32_t dn;
+			uint32_t move;
+			uint32_t work;
+			int16_t remaining;
+			uint16_t filler;
+			uint32_t filler2;
+		};
+
+		void init(size_t mb_size);
+		void clear();
+		[[nodiscard]] bool probe(uint64_t key, int remaining, mate_entry& found);
+		void save(uint64_t key, int remaining, uint32_t pn, uint32_t dn, uint32_t move, uint64_t work);
+		[[nodiscard]] size_t size() const
+		{
+			return buckets_.size() * sizeof(bucket);
+		}
+
+	private:
+		static constexpr int bucket_size = 2;
+		static constexpr int lock_count = 1024;
+
+		struct CACHE_ALIGN bucket
+		{
+			mate_entry entry[bucket_size];
+		};
+
+		std::vector<bucket> buckets_;
+		Mutex locks_[lock_count];
+	};
+
+	enum solveresult : int
+	{
+		solve_running,
+		solve_mate,
+		solve_no_mate
+	};
+
+	// the table and the progress of the solver threads of one engine instance. all threads work on the
+	// same mate length; once the root is disproven for it, the next longer mate is tried
+	struct solver
+	{
+		mate_hash table;
+		std::atomic_int moves{};
+		std::atomic_int result{};
+		int limit{};
+	};
+
+	void begin(int mate_moves);
+	bool solve(thread& th);
+}
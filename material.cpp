@@ -17,6 +17,7 @@
 #include "material.h"
 
 #include "bitboard.h"
+#include "engine.h"
 #include "macro/side.h"
 #include "fire.h"
 #include "pragma.h"
@@ -156,7 +157,7 @@ namespace material
 			popcnt(pos.pieces(black, pt_bishop) & ~dark_squares), popcnt(pos.pieces(black, pt_bishop) & dark_squares),
 			pos.number(black, pt_rook), pos.number(black, pt_queen));
 
-		hash_entry->value_function_index = thread_pool.end_games.probe_value(pos.material_key());
+		hash_entry->value_function_index = pos.instance().thread_pool.end_games.probe_value(pos.material_key());
 		if (hash_entry->value_function_index >= 0)
 			return hash_entry;
 
@@ -169,7 +170,7 @@ namespace material
 
 		auto strong_side = num_sides;
 
-		if (const auto scale_factor = thread_pool.end_games.probe_scale_factor(pos.material_key(), strong_side); scale_factor >= 0)
+		if (const auto scale_factor = pos.instance().thread_pool.end_games.probe_scale_factor(pos.material_key(), strong_side); scale_factor >= 0)
 		{
 			hash_entry->scale_function_index[strong_side] = scale_factor;
 			return hash_entry;
@@ -227,7 +228,7 @@ namespace material
 	// retrieve endgame value from material hash
 	int mat_hash_entry::value_from_function(const position& pos) const
 	{
-		return (*thread_pool.end_games.value_functions[value_function_index])(pos);
+		return (*pos.instance().thread_pool.end_games.value_functions[value_function_index])(pos);
 	}
 
 	// retrieve scale factor from material hash
@@ -235,7 +236,7 @@ namespace material
 	{
 		if (scale_function_index[color] >= 0)
 		{
-			if (const auto scale_factor = (*thread_pool.end_games.factor_functions[scale_function_index[color]])(pos); scale_factor != no_factor)
+			if (const auto scale_factor = (*pos.instance().thread_pool.end_games.factor_functions[scale_function_index[color]])(pos); scale_factor != no_factor)
 				return scale_factor;
 		}
 		return static_cast<sfactor>(factor[color]);
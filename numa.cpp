@@ -0,0 +1,235 @@
+/*
+  Fire is a freeware UCI chess playing engine authored by Norman Schmidt.
+
+  Fire utilizes many state-of-the-art chess programming ideas and techniques
+  which have been documented in detail at https://www.chessprogramming.org/
+  and demonstrated via the very strong open-source chess engine Stockfish...
+  https://github.com/official-stockfish/Stockfish.
+  
+  Fire is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or any later version.
+
+  You should have received a copy of the GNU General Public License with
+  this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "numa.h"
+
+namespace numa
+{
+	namespace
+	{
+		// cpus of each online node, index = node number
+		std::vector<std::vector<int>> nodes;
+
+#ifdef __linux__
+		constexpr int mpol_preferred = 1;
+		constexpr int mpol_interleave = 3;
+		constexpr unsigned mpol_mf_move = 1 << 1;
+		constexpr int max_nodes = 64;
+
+		// parse a kernel cpu list such as "0-15,32-47"
+		std::vector<int> parse_cpu_list(const std::string& list)
+		{
+			std::vector<int> cpus;
+			std::stringstream ss(list);
+			std::string range;
+
+			while (std::getline(ss, range, ','))
+			{
+				if (range.empty())
+					continue;
+				const auto dash = range.find('-');
+				const auto first = std::stoi(range.substr(0, dash));
+				const auto last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+				for (auto cpu = first; cpu <= last; ++cpu)
+					cpus.push_back(cpu);
+			}
+			return cpus;
+		}
+
+		void mbind(void* mem, const size_t size, const int mode, const uint64_t node_mask)
+		{
+			// mbind works on whole pages, so shrink the range to the pages inside the block
+			constexpr uintptr_t page = 4096;
+			const auto begin = (reinterpret_cast<uintptr_t>(mem) + page - 1) & ~(page - 1);
+			const auto end = reinterpret_cast<uintptr_t>(mem) + size & ~(page - 1);
+
+			if (end > begin)
+				syscall(SYS_mbind, begin, end - begin, mode, &node_mask, max_nodes, mpol_mf_move);
+		}
+#endif
+	}
+
+	// detect online NUMA nodes and the cpus attached to each
+	void init()
+	{
+		nodes.clear();
+
+#ifdef __linux__
+		for (auto node = 0; node < max_nodes; ++node)
+		{
+			std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			if (!file)
+				continue;
+
+			std::string list;
+			std::getline(file, list);
+			if (auto cpus = parse_cpu_list(list); !cpus.empty())
+			{
+				nodes.resize(node + 1);
+				nodes[node] = cpus;
+			}
+		}
+#endif
+
+		// no NUMA information: one node holding every cpu
+		if (nodes.empty())
+		{
+			nodes.resize(1);
+			for (auto cpu = 0; cpu < static_cast<int>(std::thread::hardware_concurrency()); ++cpu)
+				nodes[0].push_back(cpu);
+		}
+	}
+
+	int node_count()
+	{
+		return static_cast<int>(nodes.size());
+	}
+
+	// node of the cpu the calling thread is running on
+	int current_node()
+	{
+#ifdef __linux__
+		const auto cpu = sched_getcpu();
+		for (auto node = 0; node < node_count(); ++node)
+			for (const auto c : nodes[node])
+				if (c == cpu)
+					return node;
+#endif
+		return 0;
+	}
+
+	const std::vector<int>& node_cpus(const int node)
+	{
+		return nodes[node];
+	}
+
+	// set the memory policy of a block before it is first touched:
+	// interleave spreads pages round robin over all nodes, local prefers the caller's node
+	// (pages already touched are moved to match the policy)
+	void place(void* mem, const size_t size, const numapolicy policy)
+	{
+#ifdef __linux__
+		if (policy == numa_off || node_count() < 2)
+			return;
+
+		if (policy == numa_interleave)
+		{
+			uint64_t mask = 0;
+			for (auto node = 0; node < node_count(); ++node)
+				if (!nodes[node].empty())
+					mask |= static_cast<uint64_t>(1) << node;
+			mbind(mem, size, mpol_interleave, mask);
+		}
+		else
+			mbind(mem, size, mpol_preferred, static_cast<uint64_t>(1) << current_node());
+#else
+		(void)mem;
+		(void)size;
+		(void)policy;
+#endif
+	}
+
+	numapolicy policy_from_string(const std::string& str)
+	{
+		if (str == "interleave")
+			return numa_interleave;
+		if (str == "local")
+			return numa_local;
+		return numa_off;
+	}
+
+	const char* policy_name(const numapolicy policy)
+	{
+		switch (policy)
+		{
+		case numa_interleave: return "interleave";
+		case numa_local: return "local";
+		default: return "off";
+		}
+	}
+
+	// node that search thread index is assigned to: threads go round robin over the nodes with cpus
+	int thread_node(const int index)
+	{
+		std::vector<int> used;
+		for (auto node = 0; node < node_count(); ++node)
+			if (!nodes[node].empty())
+				used.push_back(node);
+
+		return used.empty() ? 0 : used[index % used.size()];
+	}
+
+	// pin the calling thread to its node (see thread_node), either to one cpu of the node (core)
+	// or to all of its cpus (node); none lets the thread run on every cpu again
+	void bind_thread(const int index, const bindingmode mode)
+	{
+#ifdef __linux__
+		auto used = 0;
+		for (auto node = 0; node < node_count(); ++node)
+			used += !nodes[node].empty();
+		if (!used)
+			return;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+
+		const auto& cpus = nodes[thread_node(index)];
+		if (mode == bind_core)
+			CPU_SET(cpus[index / used % cpus.size()], &set);
+		else if (mode == bind_node)
+			for (const auto cpu : cpus)
+				CPU_SET(cpu, &set);
+		else
+			for (const auto& node : nodes)
+				for (const auto cpu : node)
+					CPU_SET(cpu, &set);
+
+		sched_setaffinity(0, sizeof set, &set);
+#else
+		(void)index;
+		(void)mode;
+#endif
+	}
+
+	bindingmode binding_from_string(const std::string& str)
+	{
+		if (str == "core")
+			return bind_core;
+		if (str == "node")
+			return bind_node;
+		return bind_none;
+	}
+
+	const char* binding_name(const bindingmode mode)
+	{
+		switch (mode)
+		{
+		case bind_core: return "core";
+		case bind_node: return "node";
+		default: return "none";
+		}
+	}
+}
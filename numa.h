@@ -0,0 +1,52 @@
+/*
+  Fire is a freeware UCI chess playing engine authored by Norman Schmidt.
+
+  Fire utilizes many state-of-the-art chess programming ideas and techniques
+  which have been documented in detail at https://www.chessprogramming.org/
+  and demonstrated via the very strong open-source chess engine Stockfish...
+  https://github.com/official-stockfish/Stockfish.
+  
+  Fire is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or any later version.
+
+  You should have received a copy of the GNU General Public License with
+  this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+
+#include "fire.h"
+
+// placement of large shared tables across the NUMA nodes of the host
+enum numapolicy : uint8_t
+{
+	numa_off,
+	numa_interleave,
+	numa_local
+};
+
+// how search threads are pinned to the cpus of the host
+enum bindingmode : uint8_t
+{
+	bind_none,
+	bind_core,
+	bind_node
+};
+
+namespace numa
+{
+	void init();
+	int node_count();
+	int current_node();
+	const std::vector<int>& node_cpus(int node);
+	void place(void* mem, size_t size, numapolicy policy);
+	numapolicy policy_from_string(const std::string& str);
+	const char* policy_name(numapolicy policy);
+	int thread_node(int index);
+	void bind_thread(int index, bindingmode mode);
+	bindingmode binding_from_string(const std::string& str);
+	const char* binding_name(bindingmode mode);
+}
@@ -21,6 +21,7 @@
 
 #include "bitboard.h"
 #include "define.h"
+#include "engine.h"
 #include "macro/side.h"
 #include "macro/square.h"
 #include "macro/file.h"
@@ -149,6 +150,8 @@ void position::copy_position(const position* pos, thread* th, position_info* cop
 		this_thread_ = th;
 		thread_info_ = th->ti;
 		cmh_info_ = th->cmhi;
+		engine_ = &th->instance();
+		counter_ = th->counter;
 		pos_info_ = th->ti->position_inf + 5;
 
 		auto* orig_st = pos->thread_info_->position_inf + 5;
@@ -262,7 +265,8 @@ bool position::give_check(const uint32_t move) const
 
 void position::init()
 {
-	util::random rng(static_cast<uint32_t>(std::chrono::system_clock::now().time_since_epoch().count()));
+	// fixed seed: every process must hash a position to the same key to share a hash table or hash file
+	util::random rng(1070372);
 
 	for (auto color = white; color <= black; ++color)
 		for (auto piece = pt_king; piece <= pt_queen; ++piece)
@@ -298,7 +302,7 @@ void position::init_hash_move50(const int fifty_move_distance)
 
 bool position::is_draw() const
 {
-	if (pos_info_->draw50_moves >= 2 * thread_pool.fifty_move_distance)
+	if (pos_info_->draw50_moves >= 2 * engine_->thread_pool.fifty_move_distance)
 	{
 		if (pos_info_->draw50_moves == 100)
 			return !pos_info_->in_check || at_least_one_legal_move(*this);
@@ -402,7 +406,7 @@ void position::play_move(const uint32_t move, const bool gives_check)
 {
 	assert(is_ok(move));
 
-	++nodes_;
+	increase_nodes();
 	auto key = pos_info_->key ^ zobrist::on_move;
 
 	std::memcpy(pos_info_ + 1, pos_info_, offsetof(position_info, key));
@@ -534,7 +538,7 @@ void position::play_move(const uint32_t move, const bool gives_check)
 		pos_info_->draw50_moves = 0;
 	}
 
-	main_hash.prefetch_entry(key);
+	engine_->main_hash.prefetch_entry(key);
 
 	piece_bb_[all_pieces] = color_bb_[white] | color_bb_[black];
 
@@ -556,13 +560,13 @@ void position::play_move(const uint32_t move, const bool gives_check)
 
 void position::play_null_move()
 {
-	++nodes_;
+	increase_nodes();
 
 	auto key = pos_info_->key ^ zobrist::on_move;
 	if (pos_info_->enpassant_square != no_square)
 		key ^= zobrist::enpassant[file_of(pos_info_->enpassant_square)];
 
-	main_hash.prefetch_entry(key);
+	engine_->main_hash.prefetch_entry(key);
 
 	std::memcpy(pos_info_ + 1, pos_info_, offsetof(position_info, key));
 	pos_info_++;
@@ -858,6 +862,8 @@ position& position::set(const std::string& fen_str, const bool is_chess960, thre
 	this_thread_ = th;
 	thread_info_ = th->ti;
 	cmh_info_ = th->cmhi;
+	engine_ = &th->instance();
+	counter_ = th->counter;
 	set_position_info(pos_info_);
 	calculate_check_pins();
 
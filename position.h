@@ -15,11 +15,14 @@
 */
 
 #pragma once
+#include <atomic>
+
 #include "bitboard.h"
 #include "fire.h"
 
 class position;
 class thread;
+struct engine;
 
 struct s_move;
 struct threadinfo;
@@ -32,6 +35,19 @@ typedef piece_square_stats<24576, 24576> counter_move_values;
 
 constexpr int delayed_number{7};
 
+// node and tablebase hit counts of one search thread, on a cache line of its own:
+// only the owning thread writes them, the pool sums them when it reports
+struct CACHE_ALIGN threadcounter
+{
+	std::atomic<uint64_t> nodes, tb_hits;
+
+	void reset()
+	{
+		nodes.store(0, std::memory_order_relaxed);
+		tb_hits.store(0, std::memory_order_relaxed);
+	}
+};
+
 enum ptype : uint8_t
 {
 	no_piece,
@@ -229,9 +245,11 @@ public:
 	[[nodiscard]] int game_phase() const;
 	[[nodiscard]] int game_ply() const;
 	void increase_game_ply();
+	void increase_nodes();
 	void increase_tb_hits();
 	[[nodiscard]] bool is_chess960() const;
 	[[nodiscard]] thread* my_thread() const;
+	[[nodiscard]] engine& instance() const;
 	[[nodiscard]] threadinfo* thread_info() const;
 	[[nodiscard]] cmhinfo* cmh_info() const;
 	[[nodiscard]] uint64_t visited_nodes() const;
@@ -260,6 +278,8 @@ private:
 	position_info* pos_info_;
 	side on_move_;
 	thread* this_thread_;
+	engine* engine_;
+	threadcounter* counter_;
 	threadinfo* thread_info_;
 	cmhinfo* cmh_info_;
 	ptype board_[num_squares];
@@ -271,7 +291,6 @@ private:
 	uint8_t castle_mask_[num_squares];
 	square castle_rook_square_[num_squares];
 	uint64_t castle_path_[castle_possible_n];
-	uint64_t nodes_, tb_hits_;
 	int game_ply_;
 	bool chess960_;
 	char filler_[32];
@@ -414,9 +433,14 @@ inline void position::increase_game_ply()
 	++game_ply_;
 }
 
+inline void position::increase_nodes()
+{
+	counter_->nodes.store(counter_->nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
 inline void position::increase_tb_hits()
 {
-	++tb_hits_;
+	counter_->tb_hits.store(counter_->tb_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 }
 
 inline bool position::is_capture_move(const uint32_t move) const
@@ -470,6 +494,12 @@ inline thread* position::my_thread() const
 	return this_thread_;
 }
 
+// the engine instance of the position's thread, kept here so the search does not look it up per node
+inline engine& position::instance() const
+{
+	return *engine_;
+}
+
 inline int position::non_pawn_material(const side color) const
 {
 	return pos_info_->non_pawn_material[color];
@@ -569,7 +599,7 @@ inline int position::psq_score() const
 
 inline uint64_t position::tb_hits() const
 {
-	return tb_hits_;
+	return counter_->tb_hits.load(std::memory_order_relaxed);
 }
 
 inline threadinfo* position::thread_info() const
@@ -584,7 +614,7 @@ inline int position::total_num_pieces() const
 
 inline uint64_t position::visited_nodes() const
 {
-	return nodes_;
+	return counter_->nodes.load(std::memory_order_relaxed);
 }
 
 
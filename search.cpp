@@ -16,12 +16,15 @@
 
 #include "search.h"
 
+#include <iomanip>
 #include <sstream>
 
 #include "chrono.h"
+#include "engine.h"
 #include "evaluate.h"
 #include "fire.h"
 #include "hash.h"
+#include "mate.h"
 #include "movegen.h"
 #include "movepick.h"
 #include "pragma.h"
@@ -33,9 +36,16 @@ namespace search
 {
 	void adjust_time_after_ponder_hit()
 	{
-		main_hash.new_age();
-		if (param.use_time_calculating())
-			time_control.adjustment_after_ponder_hit();
+		main_hash().new_age();
+		if (param().use_time_calculating())
+			time_control().adjustment_after_ponder_hit();
+	}
+
+	// bumps one of the thread's search counters, compiled out unless built with searchstats=yes
+	inline void count_stat(thread* th, uint64_t search_counters::* counter)
+	{
+		if constexpr (use_search_stats)
+			++(th->search_stats.*counter);
 	}
 
 	// alpha-beta pruning utilizing minimax algorithm, effectively eliminating 'unpromising' branches of the search tree...
@@ -59,6 +69,9 @@ namespace search
 
 		constexpr auto late_move_count_max_depth = 16;
 
+		constexpr auto abdada_min_depth = 6;
+		constexpr auto max_deferred_moves = 32;
+
 		constexpr auto quiet_moves_max_gain_base = -44;
 		constexpr auto sort_cmp_sort_value = -200;
 
@@ -70,7 +83,8 @@ namespace search
 		assert(depth >= plies && depth < max_depth);
 
 		uint32_t quiet_moves[max_quiet_moves];
-		main_hash_entry* hash_entry = nullptr;
+		main_hash_entry hash_snapshot;
+		const main_hash_entry* hash_entry = nullptr;
 
 		uint64_t key64 = 0;
 
@@ -95,36 +109,29 @@ namespace search
 		const auto root_node = pv_node && pi->ply == 1;
 
 		auto* my_thread = pos.my_thread();
+		auto& instance = pos.instance();
 		state_check = pi->in_check;
 		move_number = 0;
 		quiet_move_number = 0;
 		pi->move_number = 0;
 
-		if (my_thread == thread_pool.main())
-		{
-			if (auto * main_thread = static_cast<mainthread*>(my_thread); ++main_thread->interrupt_counter >= 4096)
-			{
-				if (main_thread->quick_move_evaluation_busy)
-				{
-					if (main_thread->quick_move_evaluation_stopped)
-						return alpha;
-					if (auto elapsed = time_control.elapsed(); elapsed > 1000 || elapsed > time_control.optimum() / 16)
-					{
-						main_thread->quick_move_evaluation_stopped = true;
-						return alpha;
-					}
-				}
-				send_time_info();
-				main_thread->interrupt_counter = 0;
-			}
-		}
+		// the clock is watched by the timer thread, which stops a quick move check that takes too long
+		if (my_thread == instance.thread_pool.main()
+			&& static_cast<mainthread*>(my_thread)->quick_move_evaluation.load(std::memory_order_relaxed) == quick_move_stopped)
+			return alpha;
+
+		// a node limited search stops when a thread finds the node budget spent
+		if (pos.visited_nodes() >= my_thread->node_quota && !instance.thread_pool.claim_nodes(my_thread))
+			return alpha;
+
+		count_stat(my_thread, pv_node ? &search_counters::pv_nodes : &search_counters::non_pv_nodes);
 
 		if (!root_node)
 		{
-			if (signals.stop_analyzing.load(std::memory_order_relaxed) || pi->move_repetition || pi->ply >= max_ply)
+			if (instance.search_state.signals.stop_analyzing.load(std::memory_order_relaxed) || pi->move_repetition || pi->ply >= max_ply)
 				return pi->ply >= max_ply && !state_check
 				? evaluate::eval(pos, no_score, no_score)
-				: draw[pos.on_move()];
+				: instance.search_state.draw[pos.on_move()];
 
 			alpha = std::max(gets_mated(pi->ply), alpha);
 			beta = std::min(gives_mate(pi->ply + 1), beta);
@@ -148,7 +155,7 @@ namespace search
 
 		key64 = pi->key;
 		key64 ^= pos.draw50_key();
-		hash_entry = main_hash.probe(key64);
+		hash_entry = instance.main_hash.probe(key64, hash_snapshot);
 		hash_value = hash_entry ? value_from_hash(hash_entry->value(), pi->ply) : no_score;
 		hash_move = root_node
 			? my_thread->root_moves[my_thread->active_pv].pv[0]
@@ -171,13 +178,14 @@ namespace search
 					update_stats_minus(pos, state_check, hash_move, depth);
 			}
 
+			count_stat(my_thread, &search_counters::hash_cutoffs);
 			return hash_value;
 		}
 
-		if (!root_node && tb_number && depth >= tb_probe_depth && pos.material_or_castle_changed())
+		if (!root_node && instance.search_state.tb_number && depth >= instance.search_state.tb_probe_depth && pos.material_or_castle_changed())
 		{
-			if (auto number_pieces = pos.total_num_pieces(); number_pieces <= tb_number
-				&& depth >= tb_probe_depth
+			if (auto number_pieces = pos.total_num_pieces(); number_pieces <= instance.search_state.tb_number
+				&& depth >= instance.search_state.tb_probe_depth
 				&& !pos.castling_possible(all))
 			{
 				auto value = no_score;
@@ -190,10 +198,9 @@ namespace search
 
 				if (value != no_score)
 				{
-					hash_entry = main_hash.replace(key64);
-					hash_entry->save(key64, value_to_hash(value, pi->ply), exact_value,
+					instance.main_hash.replace(key64)->save(key64, value_to_hash(value, pi->ply), exact_value,
 						std::min(max_depth - plies, depth + 6 * plies),
-						no_move, no_score, main_hash.age());
+						no_move, no_score, instance.main_hash.age());
 
 					return value;
 				}
@@ -226,9 +233,8 @@ namespace search
 			if (pi->eval_is_exact && !root_node)
 				return eval;
 
-			hash_entry = main_hash.replace(key64);
-			hash_entry->save(key64, no_score, no_limit + pi->strong_threat, no_depth, no_move,
-				pi->position_value, main_hash.age());
+			instance.main_hash.replace(key64)->save(key64, no_score, no_limit + pi->strong_threat, no_depth, no_move,
+				pi->position_value, instance.main_hash.age());
 		}
 
 		if (pi->previous_move != null_move
@@ -250,12 +256,19 @@ namespace search
 			&& !hash_move
 			&& eval + razor_margin <= alpha)
 		{
+			count_stat(my_thread, &search_counters::razor_tries);
 			if (constexpr auto razoring_qs_min_depth = 2; depth < razoring_qs_min_depth * plies)
+			{
+				count_stat(my_thread, &search_counters::razor_cutoffs);
 				return q_search<nonPV, false>(pos, alpha, beta, depth_0);
+			}
 
 			auto r_alpha = alpha - razor_margin;
 			if (auto val = q_search<nonPV, false>(pos, r_alpha, r_alpha + score_1, depth_0); val <= r_alpha)
+			{
+				count_stat(my_thread, &search_counters::razor_cutoffs);
 				return val;
+			}
 		}
 
 		if (constexpr auto futility_min_depth = 7; !root_node
@@ -263,7 +276,10 @@ namespace search
 			&& eval - futility_margin(depth) >= beta
 			&& eval < win_score
 			&& pi->non_pawn_material[pos.on_move()])
+		{
+			count_stat(my_thread, &search_counters::futility_cutoffs);
 			return eval - futility_margin(depth);
+		}
 
 		if (constexpr auto null_move_min_depth = 2; !pv_node
 			&& depth >= null_move_min_depth * plies
@@ -271,7 +287,7 @@ namespace search
 			&& (!pi->strong_threat || depth >= null_move_strong_threat_mult * plies)
 			&& (pi->position_value >= beta || depth >= null_move_pos_val_less_than_beta_mult * plies)
 			&& pi->non_pawn_material[pos.on_move()]
-			&& (!thread_pool.analysis_mode || depth < null_move_max_depth * plies))
+			&& (!instance.thread_pool.analysis_mode || depth < null_move_max_depth * plies))
 		{
 			constexpr auto null_move_depth_greater_than_cut_node_mult = 15;
 			constexpr auto null_move_depth_greater_than_sub = 20;
@@ -280,6 +296,7 @@ namespace search
 			constexpr auto null_move_tm_mult = 66;
 			constexpr auto null_move_tm_base = 540;
 			assert(eval - beta >= 0);
+			count_stat(my_thread, &search_counters::null_tries);
 
 			auto R = no_depth;
 			R = depth < 4 * plies ? depth : (null_move_tm_base + null_move_tm_mult * (static_cast<uint32_t>(depth) / plies)
@@ -309,7 +326,10 @@ namespace search
 					value = beta;
 
 				if (constexpr auto value_greater_than_beta_max_depth = 12; depth < value_greater_than_beta_max_depth * plies && abs(beta) < win_score)
+				{
+					count_stat(my_thread, &search_counters::null_cutoffs);
 					return value;
+				}
 
 				pi->no_early_pruning = true;
 				auto val = depth - R < plies
@@ -318,10 +338,13 @@ namespace search
 				pi->no_early_pruning = false;
 
 				if (val >= beta)
+				{
+					count_stat(my_thread, &search_counters::null_cutoffs);
 					return value;
+				}
 			}
 		}
-		else if (constexpr auto dummy_null_move_threat_min_depth_mult = 6; thread_pool.dummy_null_move_threat && depth >= dummy_null_move_threat_min_depth_mult * plies && eval >= beta && (pi - 1)->lmr_reduction)
+		else if (constexpr auto dummy_null_move_threat_min_depth_mult = 6; instance.thread_pool.dummy_null_move_threat && depth >= dummy_null_move_threat_min_depth_mult * plies && eval >= beta && (pi - 1)->lmr_reduction)
 		{
 			pi->mp_end_list = (pi - 1)->mp_end_list;
 			pos.play_null_move();
@@ -360,6 +383,7 @@ namespace search
 				: std::max(see_0, (pc_beta - pi->position_value) / 2);
 			
 			movepick::init_prob_cut(pos, hash_move, s_limit);
+			count_stat(my_thread, &search_counters::prob_cut_tries);
 
 			while ((move = movepick::pick_move(pos)) != no_move)
 			{
@@ -369,7 +393,10 @@ namespace search
 					auto value = -alpha_beta<nonPV>(pos, -pc_beta, -pc_beta + score_1, pc_depth, !cut_node);
 					pos.take_move_back(move);
 					if (value >= pc_beta)
+					{
+						count_stat(my_thread, &search_counters::prob_cut_cutoffs);
 						return value;
+					}
 				}
 			}
 		}
@@ -383,7 +410,7 @@ namespace search
 			alpha_beta<nt>(pos, alpha, beta, d, !pv_node && cut_node);
 			pi->no_early_pruning = false;
 
-			hash_entry = main_hash.probe(key64);
+			hash_entry = instance.main_hash.probe(key64, hash_snapshot);
 			hash_move = hash_entry ? hash_entry->move() : no_move;
 		}
 
@@ -407,8 +434,35 @@ namespace search
 			late_move_count = 1;
 		bool discovered_check_possible = pos.discovered_check_possible();
 
-		while ((move = movepick::pick_move(pos)) != no_move)
+		// abdada: moves another thread is busy with are deferred until all other moves have been searched.
+		// a deferred move keeps the move number and move picker stage it had when it was picked, so the
+		// move count and stage based pruning and reductions treat it as if it had not been deferred
+		const auto abdada = instance.thread_pool.smp_mode == smp_abdada && instance.thread_pool.active_thread_count > 1
+			&& !root_node && depth >= abdada_min_depth * plies && !pi->excluded_move;
+		struct deferred_move
+		{
+			uint32_t move;
+			int move_number;
+			stage mp_stage;
+		} deferred_moves[max_deferred_moves];
+		auto deferred_number = 0, deferred_index = 0;
+		auto deferred_only = false;
+
+		while (true)
 		{
+			if (!deferred_only && (move = movepick::pick_move(pos)) == no_move)
+				deferred_only = true;
+
+			if (deferred_only)
+			{
+				if (deferred_index == deferred_number)
+					break;
+				const auto& deferred = deferred_moves[deferred_index++];
+				move = deferred.move;
+				move_number = deferred.move_number;
+				pi->mp_stage = deferred.mp_stage;
+			}
+
 			constexpr auto excluded_move_hash_depth_reduction = 3;
 			assert(piece_color(pos.moved_piece(move)) == pos.on_move());
 
@@ -418,11 +472,18 @@ namespace search
 			if (root_node && my_thread->root_moves.find(move) < my_thread->active_pv)
 				continue;
 
+			if (abdada && !deferred_only && move_number > 0 && deferred_number < max_deferred_moves
+				&& instance.busy_table.busy(busy_hash::move_key(pi->key, move), my_thread))
+			{
+				deferred_moves[deferred_number++] = {move, move_number, pi->mp_stage};
+				continue;
+			}
+
 			pi->move_number = ++move_number;
 
-			if (!bench_active && root_node && my_thread == thread_pool.main())
+			if (!bench_active && root_node && my_thread == instance.thread_pool.main())
 			{
-				if (constexpr auto info_currmove_interval = 4000; time_control.elapsed() > info_currmove_interval)
+				if (constexpr auto info_currmove_interval = 4000; instance.time_control.elapsed() > info_currmove_interval)
 					acout() << "info currmove " << util::move_to_string(move, pos) << " currmovenumber " << move_number + my_thread->active_pv << std::endl;
 			}
 
@@ -458,9 +519,13 @@ namespace search
 				auto r_beta = hash_value - static_cast<int>(static_cast<uint32_t>(depth) / plies * excluded_move_r_beta_hash_value_margin_mult / excluded_move_r_beta_hash_value_margin_div);
 				auto r_depth = static_cast<uint32_t>(depth) / plies / 2 * plies;
 				pi->excluded_move = move;
+				count_stat(my_thread, &search_counters::singular_tries);
 
 				if (auto value = alpha_beta<nonPV>(pos, r_beta - score_1, r_beta, r_depth, !pv_node && cut_node); value < r_beta)
+				{
+					count_stat(my_thread, &search_counters::singular_extensions);
 					extension = plies;
+				}
 
 				pi->excluded_move = no_move;
 
@@ -479,7 +544,10 @@ namespace search
 				constexpr auto predicted_depth_see_test_mult = 20;
 				constexpr auto predicted_depth_max_depth = 7;
 				if (move_number >= late_move_count)
+				{
+					count_stat(my_thread, &search_counters::late_move_prunes);
 					continue;
+				}
 
 				if (constexpr auto quiet_moves_max_depth = 6; depth < quiet_moves_max_depth * plies
 					&& pi->mp_stage >= quietmoves)
@@ -489,23 +557,35 @@ namespace search
 					if (constexpr auto sort_cmp = static_cast<int>(sort_cmp_sort_value); (!cmh || cmh->value_at_offset(offset) < sort_cmp)
 						&& (!fmh || fmh->value_at_offset(offset) < sort_cmp)
 						&& (cmh && fmh || !fmh2 || fmh2->value_at_offset(offset) < sort_cmp))
+					{
+						count_stat(my_thread, &search_counters::late_move_prunes);
 						continue;
+					}
 
 					if (constexpr auto quiet_moves_max_gain_mult = 12; pos.thread_info()->max_gain_table.get(moved_piece, move) < static_cast<int>(quiet_moves_max_gain_base)
 						- static_cast<int>(quiet_moves_max_gain_mult) * static_cast<int>(static_cast<uint32_t>(depth) / plies))
+					{
+						count_stat(my_thread, &search_counters::futility_prunes);
 						continue;
+					}
 				}
 
 				predicted_depth = std::max(new_depth - lmr_reduction(pv_node, progress, depth, move_number), depth_0);
 
 				if (predicted_depth < predicted_depth_max_depth * plies
 					&& pi->position_value + futility_margin_ext(predicted_depth) <= alpha)
+				{
+					count_stat(my_thread, &search_counters::futility_prunes);
 					continue;
+				}
 
 				if (constexpr auto predicted_depth_see_test_base = 300; predicted_depth < predicted_depth_max_depth * plies
 					&& !pos.see_test(move, std::min(see_0, predicted_depth_see_test_base
 					- predicted_depth_see_test_mult * predicted_depth * predicted_depth / 64)))
+				{
+					count_stat(my_thread, &search_counters::see_prunes);
 					continue;
+				}
 			}
 
 			else if (constexpr auto non_root_node_max_depth = 7; !root_node
@@ -517,7 +597,10 @@ namespace search
 					&& !pos.see_test(move, std::min(see_knight
 					- see_bishop, non_root_node_see_test_base
 					- non_root_node_see_test_mult * depth * depth / 64)))
+				{
+					count_stat(my_thread, &search_counters::see_prunes);
 					continue;
+				}
 			}
 
 			if (!root_node && !pos.legal_move(move))
@@ -528,6 +611,9 @@ namespace search
 
 			pos.play_move(move, gives_check);
 
+			const auto busy_key = busy_hash::move_key(pi->key, move);
+			const auto busy_marked = abdada && instance.busy_table.enter(busy_key, my_thread);
+
 			auto value = score_0;
 
 			if (constexpr auto lmr_min_depth = 3; depth >= lmr_min_depth * plies
@@ -564,16 +650,20 @@ namespace search
 				r = std::max(r, depth_0);
 				auto d = std::max(new_depth - r, plies);
 				pi->lmr_reduction = static_cast<uint8_t>(new_depth - d);
+				count_stat(my_thread, &search_counters::lmr_searches);
 
 				value = -alpha_beta<nonPV>(pos, -(alpha + score_1), -alpha, d, true);
 
 				if (constexpr auto lmr_reduction_min = 5; value > alpha && pi->lmr_reduction >= lmr_reduction_min * plies)
 				{
+					count_stat(my_thread, &search_counters::lmr_researches);
 					pi->lmr_reduction = static_cast<uint8_t>(lmr_reduction_min * plies / 2);
 					value = -alpha_beta<nonPV>(pos, -(alpha + score_1), -alpha, new_depth - lmr_reduction_min * plies / 2, true);
 				}
 
 				full_search_needed = value > alpha && pi->lmr_reduction != 0;
+				if (full_search_needed)
+					count_stat(my_thread, &search_counters::lmr_full_researches);
 				pi->lmr_reduction = 0;
 			}
 			else
@@ -609,12 +699,16 @@ namespace search
 
 			pos.take_move_back(move);
 
+			if (busy_marked)
+				instance.busy_table.leave(busy_key);
+
 			assert(value > -max_score && value < max_score);
 
-			if (signals.stop_analyzing.load(std::memory_order_relaxed))
+			if (instance.search_state.signals.stop_analyzing.load(std::memory_order_relaxed))
 				return alpha;
 
-			if (my_thread == thread_pool.main() && static_cast<mainthread*>(my_thread)->quick_move_evaluation_stopped)
+			if (my_thread == instance.thread_pool.main()
+				&& static_cast<mainthread*>(my_thread)->quick_move_evaluation.load(std::memory_order_relaxed) == quick_move_stopped)
 				return alpha;
 
 			if (root_node)
@@ -632,10 +726,10 @@ namespace search
 					for (auto* z = (pi + 1)->pv; *z != no_move; ++z)
 						root_move.pv.add(*z);
 
-					if (move_number > 1 && my_thread == thread_pool.main())
+					if (move_number > 1 && my_thread == instance.thread_pool.main())
 						static_cast<mainthread*>(my_thread)->best_move_changed += 1024;
 
-					if (!bench_active && my_thread == thread_pool.main())
+					if (!bench_active && my_thread == instance.thread_pool.main() && !instance.thread_pool.split_threads)
 						acout() << print_pv(pos, alpha, beta, my_thread->active_pv, move_index) << std::endl;
 				}
 				else
@@ -649,10 +743,10 @@ namespace search
 				if (value > alpha)
 				{
 					if (pv_node
-						&& my_thread == thread_pool.main()
-						&& easy_move.expected_move(pi->key)
-						&& (move != easy_move.expected_move(pi->key) || move_number > 1))
-						easy_move.clear();
+						&& my_thread == instance.thread_pool.main()
+						&& instance.search_state.easy_move.expected_move(pi->key)
+						&& (move != instance.search_state.easy_move.expected_move(pi->key) || move_number > 1))
+						instance.search_state.easy_move.clear();
 
 					best_move = move;
 
@@ -664,6 +758,9 @@ namespace search
 					else
 					{
 						assert(value >= beta);
+						count_stat(my_thread, &search_counters::beta_cutoffs);
+						if (move_number == 1)
+							count_stat(my_thread, &search_counters::first_move_cutoffs);
 						break;
 					}
 				}
@@ -678,7 +775,7 @@ namespace search
 			? alpha
 			: state_check
 			? gets_mated(pi->ply)
-			: draw[pos.on_move()];
+			: instance.search_state.draw[pos.on_move()];
 
 		else if (best_move)
 		{
@@ -715,10 +812,12 @@ namespace search
 
 		if (!pi->excluded_move)
 		{
-			hash_entry = main_hash.replace(key64);
-			hash_entry->save(key64, value_to_hash(best_score, pi->ply),
+			instance.main_hash.replace(key64)->save(key64, value_to_hash(best_score, pi->ply),
 				(best_score >= beta ? south_border : pv_node && best_move ? exact_value : north_border) + pi->strong_threat,
-				depth, best_move, pi->position_value, main_hash.age());
+				depth, best_move, pi->position_value, instance.main_hash.age());
+
+			if (pv_node && best_move && best_score < beta)
+				instance.pv_table.save(key64, best_move);
 		}
 
 		return best_score;
@@ -886,19 +985,26 @@ namespace search
 		}
 
 		auto best_move = no_move;
+		auto& instance = pos.instance();
+		count_stat(pos.my_thread(), &search_counters::q_nodes);
 
 		if (pi->move_repetition || pi->ply >= max_ply)
 			return pi->ply >= max_ply && !state_check
 			? evaluate::eval(pos, no_score, no_score)
-			: draw[pos.on_move()];
+			: instance.search_state.draw[pos.on_move()];
 
 		assert(0 <= pi->ply && pi->ply < max_ply);
 
 		const auto hash_depth = state_check || depth == depth_0 ? depth_0 : -plies;
 
+		// with QSearchCache on, q_search probes and stores only the thread's own cache
+		const auto q_cache = instance.thread_pool.q_search_cache;
+		auto& q_table = pos.thread_info()->q_search_table;
+
 		auto key64 = pi->key;
 		key64 ^= pos.draw50_key();
-		auto* hash_entry = main_hash.probe(key64);
+		main_hash_entry hash_snapshot;
+		const auto* hash_entry = q_cache ? q_table.probe(key64, hash_snapshot) : instance.main_hash.probe(key64, hash_snapshot);
 		const auto hash_move = hash_entry ? hash_entry->move() : no_move;
 		const auto hash_value = hash_entry ? value_from_hash(hash_entry->value(), pi->ply) : no_score;
 
@@ -907,10 +1013,11 @@ namespace search
 			&& hash_entry->depth() >= hash_depth
 			&& (hash_value >= beta ? hash_entry->bounds() & south_border : hash_entry->bounds() & north_border))
 		{
+			count_stat(pos.my_thread(), &search_counters::q_hash_cutoffs);
 			return hash_value;
 		}
 
-		if (tb_number && tb_probe_depth <= 0 && pos.material_or_castle_changed()
+		if (instance.search_state.tb_number && instance.search_state.tb_probe_depth <= 0 && pos.material_or_castle_changed()
 			&& pos.total_num_pieces() <= egtb::max_pieces_wdl
 			&& calculate_egtb_use(pos) == egtb_helpful
 			&& !pos.castling_possible(all))
@@ -952,9 +1059,8 @@ namespace search
 
 				if (best_value >= beta)
 				{
-					hash_entry = main_hash.replace(key64);
-					hash_entry->save(key64, value_to_hash(best_value, pi->ply), south_border + pi->strong_threat,
-						no_depth, no_move, pi->position_value, main_hash.age());
+					(q_cache ? q_table.replace(key64) : instance.main_hash.replace(key64))->save(key64, value_to_hash(best_value, pi->ply), south_border + pi->strong_threat,
+						no_depth, no_move, pi->position_value, instance.main_hash.age());
 					return best_value;
 				}
 			}
@@ -1069,9 +1175,8 @@ namespace search
 					}
 					else
 					{
-						hash_entry = main_hash.replace(key64);
-						hash_entry->save(key64, value_to_hash(value, pi->ply), south_border + pi->strong_threat,
-							hash_depth, move, pi->position_value, main_hash.age());
+						(q_cache ? q_table.replace(key64) : instance.main_hash.replace(key64))->save(key64, value_to_hash(value, pi->ply), south_border + pi->strong_threat,
+							hash_depth, move, pi->position_value, instance.main_hash.age());
 
 						return value;
 					}
@@ -1082,10 +1187,9 @@ namespace search
 		if (state_check && best_value == -max_score)
 			return gets_mated(pi->ply);
 
-		hash_entry = main_hash.replace(key64);
-		hash_entry->save(key64, value_to_hash(best_value, pi->ply),
+		(q_cache ? q_table.replace(key64) : instance.main_hash.replace(key64))->save(key64, value_to_hash(best_value, pi->ply),
 			(pv_node && best_value > orig_alpha ? exact_value : north_border) + pi->strong_threat,
-			hash_depth, best_move, pi->position_value, main_hash.age());
+			hash_depth, best_move, pi->position_value, instance.main_hash.age());
 
 		assert(best_value > -max_score && best_value < max_score);
 
@@ -1095,48 +1199,71 @@ namespace search
 	// reset history, evasion history, max gain, counter moves, followup moves, and capture history
 	void reset()
 	{
-		main_hash.clear();
-		threadpool::delete_counter_move_history();
+		main_hash().clear();
+		pv_table().clear();
+		thread_pool().delete_counter_move_history();
 
-		for (auto i = 0; i < thread_pool.thread_count; ++i)
+		for (auto i = 0; i < thread_pool().pooled_count; ++i)
 		{
-			const auto* th = thread_pool.threads[i];
+			const auto* th = thread_pool().threads[i];
 			th->ti->history.clear();
 			th->ti->evasion_history.clear();
 			th->ti->max_gain_table.clear();
 			th->ti->counter_moves.clear();
 			th->ti->counter_followup_moves.clear();
 			th->ti->capture_history.clear();
+			th->ti->q_search_table.clear();
 		}
 
 		// set score and depth back to 0
-		thread_pool.main()->previous_root_score = max_score;
-		thread_pool.main()->previous_root_depth = 999 * plies;
-		thread_pool.main()->quick_move_allow = false;
+		mate_solver().table.clear();
+
+		thread_pool().main()->previous_root_score = max_score;
+		thread_pool().main()->previous_root_depth = 999 * plies;
+		thread_pool().main()->quick_move_allow = false;
 	}
 
-	void send_time_info()
+	// called by the timer thread while a search runs; returns the milliseconds until the next call is due:
+	// the time limit when it is close, otherwise a few milliseconds, so the timer rarely preempts the search
+	int send_time_info()
 	{
-		const auto elapsed = time_control.elapsed();
+		constexpr auto max_interval = 10;
+
+		const auto elapsed = time_control().elapsed();
+
+		if (auto busy = static_cast<int>(quick_move_busy); elapsed > 1000 || elapsed > time_control().optimum() / 16)
+			thread_pool().main()->quick_move_evaluation.compare_exchange_strong(busy, quick_move_stopped);
 
 		// don't send info if running bench or more frequently than once per second
-		if (!bench_active && elapsed - previous_info_time >= 1000)
+		if (!bench_active && elapsed - previous_info_time() >= 1000)
 		{
-			previous_info_time = (elapsed + 100) / 1000 * 1000;
-			const auto nodes = thread_pool.visited_nodes();
+			previous_info_time() = (elapsed + 100) / 1000 * 1000;
+			const auto nodes = thread_pool().visited_nodes();
 			const auto nps = elapsed ? nodes / elapsed * 1000 : 0;
-			const auto tb_hits = thread_pool.tb_hits();
+			const auto tb_hits = thread_pool().tb_hits();
 			acout() << "info time " << elapsed << " nodes " << nodes << " nps " << nps
-				<< " tbhits " << tb_hits << " hashfull " << main_hash.hash_full() << std::endl;
+				<< " tbhits " << tb_hits << " hashfull " << main_hash().hash_full() << std::endl;
 		}
 
-		if (param.ponder)
-			return;
+		if (param().ponder)
+			return max_interval;
+
+		// node limits are enforced by the search threads themselves, see threadpool::claim_nodes
+		if (param().use_time_calculating() && elapsed > time_control().maximum() - 10
+			|| param().move_time && elapsed >= param().move_time)
+		{
+			thread_pool().mark_stop();
+			signals().stop_analyzing = true;
+			thread_pool().main()->wake(false);
+			return max_interval;
+		}
 
-		if (param.use_time_calculating() && elapsed > time_control.maximum() - 10
-			|| param.move_time && elapsed >= param.move_time
-			|| param.nodes && thread_pool.visited_nodes() >= param.nodes)
-			signals.stop_analyzing = true;
+		auto interval = static_cast<int64_t>(max_interval);
+		if (param().use_time_calculating())
+			interval = std::min(interval, time_control().maximum() - 9 - elapsed);
+		if (param().move_time)
+			interval = std::min(interval, param().move_time - elapsed);
+		return static_cast<int>(std::max(interval, int64_t{1}));
 	}
 
 	// update history, killers, and countermoves
@@ -1301,61 +1428,62 @@ namespace search
 
 void mainthread::begin_search()
 {
-	search::running = true;
-	root_position->copy_position(thread_pool.root_position, nullptr, nullptr);
+	search::running() = true;
+	root_position->copy_position(thread_pool().root_position, nullptr, nullptr);
 	const auto me = root_position->on_move();
-	time_control.init(search::param, me, root_position->game_ply());
-	search::previous_info_time = 0;
-	interrupt_counter = 0;
+	time_control().init(search::param(), me, root_position->game_ply());
+	search::previous_info_time() = 0;
+	thread_pool().timer->watch(true);
 
-	thread_pool.contempt_color = me;
-	thread_pool.analysis_mode = !search::param.use_time_calculating();
+	thread_pool().contempt_color = me;
+	thread_pool().analysis_mode = !search::param().use_time_calculating();
 
-	thread_pool.fifty_move_distance = std::min(50, std::max(thread_pool.fifty_move_distance, root_position->fifty_move_counter() / 2 + 5));
-	thread_pool.piece_contempt = uci_contempt;
-	if (thread_pool.piece_contempt)
+	thread_pool().fifty_move_distance = std::min(50, std::max(thread_pool().fifty_move_distance, root_position->fifty_move_counter() / 2 + 5));
+	thread_pool().piece_contempt = uci_contempt;
+	if (thread_pool().piece_contempt)
 	{
-		if (thread_pool.analysis_mode)
-			thread_pool.contempt_color = white;
+		if (thread_pool().analysis_mode)
+			thread_pool().contempt_color = white;
 
-		const auto temp_contempt = thread_pool.piece_contempt;
-		thread_pool.piece_contempt = 0;
+		const auto temp_contempt = thread_pool().piece_contempt;
+		thread_pool().piece_contempt = 0;
 		const auto v1 = evaluate::eval(*root_position, no_score, no_score);
-		thread_pool.piece_contempt = temp_contempt;
+		thread_pool().piece_contempt = temp_contempt;
 		
 		if (const auto v2 = evaluate::eval(*root_position, no_score, no_score); abs(v1) < win_score && abs(v2) < win_score)
-			thread_pool.root_contempt_value = v2 - v1;
+			thread_pool().root_contempt_value = v2 - v1;
 		else
-			thread_pool.root_contempt_value = score_0;
+			thread_pool().root_contempt_value = score_0;
 	}
-	thread_pool.multi_pv = thread_pool.multi_pv_max = uci_multipv;
-	thread_pool.active_thread_count = thread_pool.thread_count;
+	thread_pool().multi_pv = thread_pool().multi_pv_max = uci_multipv;
+	thread_pool().active_thread_count = thread_pool().thread_count;
 
-	if (thread_pool.analysis_mode)
+	if (thread_pool().analysis_mode)
 	{
-		search::draw[me] = draw_score;
-		search::draw[~me] = draw_score;
+		search::draw()[me] = draw_score;
+		search::draw()[~me] = draw_score;
 	}
 	else
 	{
 		constexpr auto default_draw_value = 24;
-		search::draw[me] = draw_score - default_draw_value * root_position->game_phase() / middlegame_phase;
-		search::draw[~me] = draw_score + default_draw_value * root_position->game_phase() / middlegame_phase;
+		search::draw()[me] = draw_score - default_draw_value * root_position->game_phase() / middlegame_phase;
+		search::draw()[~me] = draw_score + default_draw_value * root_position->game_phase() / middlegame_phase;
 	}
 
-	if (!search::param.ponder)
-		main_hash.new_age();
-	tb_root_in_tb = false;
+	if (!search::param().ponder)
+		main_hash().new_age();
+	pv_table().new_age();
+	tb_root_in_tb() = false;
 	egtb::use_rule50 = uci_syzygy_50_move_rule;
-	tb_probe_depth = uci_syzygy_probe_depth * plies;
-	tb_number = std::max(egtb::max_pieces_wdl, std::max(egtb::max_pieces_dtm, egtb::max_pieces_dtz));
+	tb_probe_depth() = uci_syzygy_probe_depth * plies;
+	tb_number() = std::max(egtb::max_pieces_wdl, std::max(egtb::max_pieces_dtm, egtb::max_pieces_dtz));
 
 	root_moves.move_number = 0;
 	for (const auto& move : legal_move_list(*root_position))
-		if (search::param.search_moves.empty() || search::param.search_moves.find(move) >= 0)
+		if (search::param().search_moves.empty() || search::param().search_moves.find(move) >= 0)
 			root_moves.add(rootmove(move));
 
-	if (thread_pool.analysis_mode)
+	if (thread_pool().analysis_mode)
 	{
 		auto* pi = root_position->info();
 		auto e = std::min(pi->draw50_moves, pi->distance_to_null_move);
@@ -1385,79 +1513,119 @@ void mainthread::begin_search()
 		root_moves.add(rootmove(no_move));
 		root_moves[0].score = root_position->is_in_check() ? -mate_score : draw_score;
 		root_moves[0].depth = main_thread_inc;
-		thread_pool.active_thread_count = 1;
+		thread_pool().active_thread_count = 1;
 	}
 	else
 	{
-		if (root_position->total_num_pieces() <= tb_number
+		if (root_position->total_num_pieces() <= tb_number()
 			&& !root_position->castling_possible(all))
 		{
 			filter_root_moves(*root_position);
 
-			if (tb_root_in_tb && root_moves.move_number == 1)
+			if (tb_root_in_tb() && root_moves.move_number == 1)
 			{
 				root_moves[0].depth = main_thread_inc;
-				root_moves[0].score = tb_score;
+				root_moves[0].score = tb_score();
 
-				if (thread_pool.analysis_mode && abs(tb_score) > longest_mate_score)
+				if (thread_pool().analysis_mode && abs(tb_score()) > longest_mate_score)
 				{
 					root_position->play_move(root_moves[0].pv[0]);
-					search::calculate_egtb_mate_pv(*root_position, tb_score, root_moves[0].pv);
+					search::calculate_egtb_mate_pv(*root_position, tb_score(), root_moves[0].pv);
 					root_position->take_move_back(root_moves[0].pv[0]);
 					root_moves[0].depth = main_thread_inc * root_moves[0].pv.size();
 				}
-				thread_pool.active_thread_count = 1;
+				thread_pool().active_thread_count = 1;
 				goto NO_ANALYSIS;
 			}
 		}
 
-		thread_pool.multi_pv_max = std::min(thread_pool.multi_pv_max, root_moves.move_number);
-		thread_pool.multi_pv = std::min(thread_pool.multi_pv, root_moves.move_number);
+		thread_pool().multi_pv_max = std::min(thread_pool().multi_pv_max, root_moves.move_number);
+		thread_pool().multi_pv = std::min(thread_pool().multi_pv, root_moves.move_number);
 
-		if (thread_pool.active_thread_count > 1)
+		if (thread_pool().active_thread_count > 1)
 		{
-			thread_pool.root_moves = root_moves;
-			thread_pool.root_position_info = root_position->info();
+			thread_pool().root_moves = root_moves;
+			thread_pool().root_position_info = root_position->info();
 		}
 
-		for (auto i = 1; i < thread_pool.active_thread_count; ++i)
-			thread_pool.threads[i]->wake(true);
+		// with MultiPVSplit the root moves are dealt out over the threads, each searching the best lines of its own moves
+		thread_pool().split_threads = thread_pool().multi_pv_split && thread_pool().multi_pv > 1
+			? std::min(thread_pool().active_thread_count, root_moves.move_number)
+			: 0;
+		if (thread_pool().split_threads < 2)
+			thread_pool().split_threads = 0;
+		else
+			thread_pool().split_moves = root_moves;
+
+		// 'go mate' runs the proof-number mate solver first, see mate.h
+		thread_pool().mate_search = uci_mate_solver && search::param().mate > 0
+			&& search::param().mate <= mate::max_mate_moves && !thread_pool().split_threads;
+		if (thread_pool().mate_search)
+			mate::begin(search::param().mate);
+
+		thread_pool().start_helpers();
 
 		thread::begin_search();
 	}
 
 NO_ANALYSIS:
 
-	if (!search::signals.stop_analyzing && (search::param.ponder || search::param.infinite))
+	if (!search::signals().stop_analyzing && (search::param().ponder || search::param().infinite))
 	{
 
 		if (root_moves[0].depth == main_thread_inc)
 			root_moves[0].depth = 99 * main_thread_inc;
 
-		search::signals.stop_if_ponder_hit = true;
-		wait(search::signals.stop_analyzing);
+		search::signals().stop_if_ponder_hit = true;
+		wait(search::signals().stop_analyzing);
 	}
 
-	search::signals.stop_analyzing = true;
+	thread_pool().mark_stop();
+	search::signals().stop_analyzing = true;
+	thread_pool().timer->watch(false);
+
+	if (thread_pool().active_thread_count > 1)
+		thread_pool().wait_for_helpers();
 
-	for (auto i = 1; i < thread_pool.active_thread_count; ++i)
-		thread_pool.threads[i]->wait_for_search_to_end();
+	if (thread_pool().split_threads)
+	{
+		root_moves = thread_pool().merged_split_moves();
+		active_pv = thread_pool().multi_pv;
+		thread_pool().split_threads = 0;
+	}
 
 	thread* best_thread = this;
 
 	if (!this->quick_move_played
-		&& thread_pool.multi_pv == 1
-		&& !search::param.depth
+		&& thread_pool().multi_pv == 1
+		&& !search::param().depth
 		&& root_moves[0].pv[0] != no_move)
 	{
-		for (auto i = 1; i < thread_pool.active_thread_count; ++i)
+		for (auto i = 1; i < thread_pool().active_thread_count; ++i)
 		{
-			if (auto * th = thread_pool.threads[i]; th->root_moves[0].score > best_thread->root_moves[0].score
+			if (auto * th = thread_pool().threads[i]; th->root_moves[0].score > best_thread->root_moves[0].score
 				&& th->completed_depth > best_thread->completed_depth)
 				best_thread = th;
 		}
 	}
 
+	// a process sharing the hash may have completed a deeper iteration on this root position
+	if (sharedroot shared{}; thread_pool().multi_pv == 1
+		&& !search::param().depth
+		&& root_moves[0].pv[0] != no_move
+		&& main_hash().shared_root(root_position->key(), shared)
+		&& shared.depth > best_thread->completed_depth)
+	{
+		if (const auto index = best_thread->root_moves.find(shared.move); index >= 0)
+		{
+			auto& best = best_thread->root_moves[0];
+			std::swap(best, best_thread->root_moves[index]);
+			best.score = shared.score;
+			best.pv.move_number = 1;
+			best.pv_from_hash(*best_thread->root_position);
+		}
+	}
+
 	previous_root_score = best_thread->root_moves[0].score;
 	previous_root_depth = best_thread->root_moves[0].depth;
 
@@ -1466,6 +1634,9 @@ NO_ANALYSIS:
 
 	if (!bench_active)
 	{
+		if constexpr (use_hash_stats)
+			acout() << hashstats::info() << std::endl;
+
 		acout() << print_pv(*best_thread->root_position, -max_score, max_score, active_pv, 0) << std::endl;
 		acout() << "bestmove " << util::move_to_string(best_thread->root_moves[0].pv[0], *root_position);
 		if (best_thread->root_moves[0].pv.size() > 1 || best_thread->root_moves[0].ponder_move_from_hash(*root_position))
@@ -1473,9 +1644,10 @@ NO_ANALYSIS:
 		acout() << std::endl;
 	}
 
-	thread_pool.total_analyze_time += static_cast<int>(time_control.elapsed());
+	thread_pool().record_latency();
+	thread_pool().total_analyze_time += static_cast<int>(time_control().elapsed());
 
-	search::running = false;
+	search::running() = false;
 }
 
 void thread::begin_search()
@@ -1489,12 +1661,21 @@ void thread::begin_search()
 
 	auto alpha = score_0, delta_alpha = score_0, delta_beta = score_0;
 	auto fast_move = no_move;
-	auto* main_thread = this == thread_pool.main() ? thread_pool.main() : nullptr;
+	auto* main_thread = this == thread_pool().main() ? thread_pool().main() : nullptr;
 	if (!main_thread)
 	{
-		root_position->copy_position(thread_pool.root_position, this, thread_pool.root_position_info);
-		root_moves = thread_pool.root_moves;
+		root_position->copy_position(thread_pool().root_position, this, thread_pool().root_position_info);
+		root_moves = thread_pool().root_moves;
+	}
+
+	if (thread_index_ < thread_pool().split_threads)
+	{
+		auto n = 0;
+		for (auto i = thread_index_; i < root_moves.move_number; i += thread_pool().split_threads)
+			root_moves[n++] = root_moves[i];
+		root_moves.move_number = n;
 	}
+	const auto multi_pv = std::min(thread_pool().multi_pv, root_moves.move_number);
 
 	auto* pi = root_position->info();
 
@@ -1516,30 +1697,37 @@ void thread::begin_search()
 		(pi + n)->ply = n + 1;
 	}
 
+	thread_pool().first_node_reached();
+
+	// the regular search takes over when the mate solver finds no mate within the limit
+	if (thread_pool().mate_search && mate::solve(*this))
+		return;
+
 	auto best_value = delta_alpha = delta_beta = alpha = -max_score;
 	auto beta = max_score;
 	completed_depth = 0 * plies;
 
 	if (main_thread)
 	{
-		fast_move = search::easy_move.expected_move(root_position->key());
-		search::easy_move.clear();
+		fast_move = search::easy_move().expected_move(root_position->key());
+		search::easy_move().clear();
 		main_thread->quick_move_played = main_thread->failed_low = false;
-		main_thread->quick_move_evaluation_busy = main_thread->quick_move_evaluation_stopped = false;
+		main_thread->quick_move_evaluation = quick_move_idle;
 		main_thread->best_move_changed = 0;
 		for (auto i = 1; i <= max_ply; i++)
 			(pi + i)->pawn_key = 0;
 	}
 
-	if (main_thread && !tb_root_in_tb && !search::param.ponder && !thread_pool.analysis_mode
-		&& main_thread->quick_move_allow && main_thread->previous_root_depth >= 12 * plies && thread_pool.multi_pv == 1)
+	if (main_thread && !tb_root_in_tb() && !search::param().ponder && !thread_pool().analysis_mode
+		&& main_thread->quick_move_allow && main_thread->previous_root_depth >= 12 * plies && thread_pool().multi_pv == 1)
 	{
-		if (auto * const hash_entry = main_hash.probe(root_position->key()); hash_entry && hash_entry->bounds() == exact_value)
+		if (main_hash_entry hash_snapshot; main_hash().probe(root_position->key(), hash_snapshot)
+			&& hash_snapshot.bounds() == exact_value)
 		{
-			const auto hash_value = search::value_from_hash(hash_entry->value(), pi->ply);
-			const auto hash_move = hash_entry->move();
+			const auto hash_value = search::value_from_hash(hash_snapshot.value(), pi->ply);
+			const auto hash_move = hash_snapshot.move();
 
-			if (const auto hash_depth = hash_entry->depth(); hash_depth >= main_thread->previous_root_depth - 3 * plies
+			if (const auto hash_depth = hash_snapshot.depth(); hash_depth >= main_thread->previous_root_depth - 3 * plies
 				&& hash_move
 				&& root_position->legal_move(hash_move)
 				&& abs(hash_value) < win_score)
@@ -1549,14 +1737,14 @@ void thread::begin_search()
 				const auto v_singular = hash_value - static_cast<int>(v_singular_margin);
 				pi->excluded_move = hash_move;
 				pi->position_value = evaluate::eval(*root_position, no_score, no_score);
-				main_thread->quick_move_evaluation_busy = true;
+				main_thread->quick_move_evaluation = quick_move_busy;
 				const auto val = search::alpha_beta<search::nonPV>(*root_position, v_singular - score_1, v_singular, depth_singular, false);
-				main_thread->quick_move_evaluation_busy = false;
+				const auto stopped = main_thread->quick_move_evaluation.exchange(quick_move_idle) == quick_move_stopped;
 				pi->excluded_move = no_move;
 
-				if (!main_thread->quick_move_evaluation_stopped && val < v_singular)
+				if (!stopped && val < v_singular)
 				{
-					search::signals.stop_analyzing = true;
+					search::signals().stop_analyzing = true;
 					root_moves[0].score = hash_value;
 					root_moves[0].pv.resize(1);
 					root_moves[0].pv[0] = hash_move;
@@ -1564,11 +1752,10 @@ void thread::begin_search()
 					root_moves[0].depth = hash_depth;
 					main_thread->quick_move_allow = false;
 					main_thread->quick_move_played = true;
-					search::easy_move.clear();
+					search::easy_move().clear();
 					completed_depth = main_thread->previous_root_depth - 2 * plies;
 					return;
 				}
-				main_thread->quick_move_evaluation_stopped = false;
 			}
 		}
 	}
@@ -1589,11 +1776,11 @@ void thread::begin_search()
 
 		if (main_thread)
 		{
-			if (search::param.depth && search_iteration - 1 >= search::param.depth)
-				search::signals.stop_analyzing = true;
+			if (search::param().depth && search_iteration - 1 >= search::param().depth)
+				search::signals().stop_analyzing = true;
 		}
 
-		if (search::signals.stop_analyzing)
+		if (search::signals().stop_analyzing)
 			break;
 
 		if (main_thread)
@@ -1602,13 +1789,13 @@ void thread::begin_search()
 			main_thread->failed_low = false;
 		}
 
-		if (!bench_active && main_thread && time_control.elapsed() > info_depth_interval)
+		if (!bench_active && main_thread && time_control().elapsed() > info_depth_interval)
 			acout() << "info depth " << search_iteration << std::endl;
 
 		for (auto i = 0; i < root_moves.move_number; i++)
 			root_moves[i].previous_score = root_moves[i].score;
 
-		for (active_pv = 0; active_pv < thread_pool.multi_pv && !search::signals.stop_analyzing; ++active_pv)
+		for (active_pv = 0; active_pv < multi_pv && !search::signals().stop_analyzing; ++active_pv)
 		{
 			const auto prev_best_move = root_moves[active_pv].pv[0];
 			auto fail_high_count = 0;
@@ -1636,26 +1823,27 @@ void thread::begin_search()
 
 				std::stable_sort(root_moves.moves + active_pv, root_moves.moves + root_moves.move_number);
 
-				if (search::signals.stop_analyzing)
+				if (search::signals().stop_analyzing)
 					break;
 
-				bool fail_high_resolve = main_thread;
+				// threads splitting multipv resolve fail highs too, their lines are reported
+				bool fail_high_resolve = main_thread || thread_index_ < thread_pool().split_threads;
 
 				if (main_thread && best_value >= beta
 					&& root_moves[active_pv].pv[0] == prev_best_move
-					&& !thread_pool.analysis_mode
-					&& time_control.elapsed() > time_control.optimum() * time_control_optimum_mult_1 / 1024)
+					&& !thread_pool().analysis_mode
+					&& time_control().elapsed() > time_control().optimum() * time_control_optimum_mult_1 / 1024)
 				{
 					if (const auto play_easy_move = root_moves[0].pv[0] == fast_move && main_thread->best_move_changed < 31; play_easy_move)
 						fail_high_resolve = false;
 
-					else if (time_control.elapsed() > time_control.optimum() * time_control_optimum_mult_2 / 1024)
+					else if (time_control().elapsed() > time_control().optimum() * time_control_optimum_mult_2 / 1024)
 					{
 						const auto improvement_factor = std::max(420, std::min(improvement_factor_min_base,
 							improvement_factor_max_base + improvement_factor_max_mult
 							* main_thread->failed_low - improvement_factor_bv_mult
 							* (best_value - main_thread->previous_root_score)));
-						if (const auto unstable_factor = 1024 + main_thread->best_move_changed; time_control.elapsed() > time_control.optimum() * unstable_factor / 1024 * improvement_factor / 1024)
+						if (const auto unstable_factor = 1024 + main_thread->best_move_changed; time_control().elapsed() > time_control().optimum() * unstable_factor / 1024 * improvement_factor / 1024)
 							fail_high_resolve = false;
 					}
 				}
@@ -1669,7 +1857,7 @@ void thread::begin_search()
 					if (main_thread)
 					{
 						main_thread->failed_low = true;
-						search::signals.stop_if_ponder_hit = false;
+						search::signals().stop_if_ponder_hit = false;
 					}
 				}
 				else if (best_value >= beta && (fail_high_resolve || best_value >= value_pawn * best_value_vp_mult))
@@ -1690,28 +1878,48 @@ void thread::begin_search()
 			std::stable_sort(root_moves.moves + 0, root_moves.moves + active_pv + 1);
 		}
 
-		if (!search::signals.stop_analyzing)
+		if (!search::signals().stop_analyzing)
+		{
 			completed_depth = root_depth;
 
+			if (main_hash().shared() && !thread_pool().split_threads)
+				main_hash().publish_root({root_position->key(), root_depth, root_moves[0].score, root_moves[0].pv[0]});
+
+			if (thread_index_ < thread_pool().split_threads)
+			{
+				thread_pool().publish_split_moves(root_moves, multi_pv);
+
+				if (!bench_active && main_thread)
+				{
+					const auto merged = thread_pool().merged_split_moves();
+					const auto lines = std::min(thread_pool().multi_pv, merged.move_number) - 1;
+					acout() << print_pv(*root_position, merged, -max_score, max_score, lines, lines) << std::endl;
+				}
+			}
+		}
+
 		if (!main_thread)
 			continue;
 
-		if (search::param.mate
+		if constexpr (use_search_stats)
+			searchstats::iteration_done(search_iteration, !search::signals().stop_analyzing);
+
+		if (search::param().mate
 			&& best_value >= longest_mate_score
-			&& mate_score - best_value <= 2 * search::param.mate)
-			search::signals.stop_analyzing = true;
+			&& mate_score - best_value <= 2 * search::param().mate)
+			search::signals().stop_analyzing = true;
 
-		if (!thread_pool.analysis_mode && !search::param.ponder && best_value > mate_score - 32
+		if (!thread_pool().analysis_mode && !search::param().ponder && best_value > mate_score - 32
 			&& root_depth >= (mate_score - best_value + root_depth_mate_value_bv_add) * plies)
-			search::signals.stop_analyzing = true;
+			search::signals().stop_analyzing = true;
 
-		if (!thread_pool.analysis_mode && !search::param.ponder && best_value < -mate_score + 32
+		if (!thread_pool().analysis_mode && !search::param().ponder && best_value < -mate_score + 32
 			&& root_depth >= (mate_score + best_value + root_depth_mate_value_bv_add) * plies)
-			search::signals.stop_analyzing = true;
+			search::signals().stop_analyzing = true;
 
-		if (!thread_pool.analysis_mode)
+		if (!thread_pool().analysis_mode)
 		{
-			if (!search::signals.stop_analyzing && !search::signals.stop_if_ponder_hit)
+			if (!search::signals().stop_analyzing && !search::signals().stop_if_ponder_hit)
 			{
 				const auto improvement_factor = std::max(420, std::min(improvement_factor_min_base, improvement_factor_max_base + improvement_factor_max_mult
 					* main_thread->failed_low - improvement_factor_bv_mult
@@ -1720,58 +1928,71 @@ void thread::begin_search()
 
 				if (const auto play_easy_move = root_moves[0].pv[0] == fast_move
 						&& main_thread->best_move_changed < 31
-						&& time_control.elapsed() > time_control.optimum() * 124 / 1024; root_moves.move_number == 1 && search_iteration > 10
-					|| time_control.elapsed() > time_control.optimum() * unstable_factor / 1024 * improvement_factor / 1024
+						&& time_control().elapsed() > time_control().optimum() * 124 / 1024; root_moves.move_number == 1 && search_iteration > 10
+					|| time_control().elapsed() > time_control().optimum() * unstable_factor / 1024 * improvement_factor / 1024
 					|| ((main_thread->quick_move_played = play_easy_move)))
 				{
-					if (search::param.ponder)
-						search::signals.stop_if_ponder_hit = true;
+					if (search::param().ponder)
+						search::signals().stop_if_ponder_hit = true;
 					else
-						search::signals.stop_analyzing = true;
+						search::signals().stop_analyzing = true;
 				}
 			}
 
 			if (root_moves[0].pv.size() >= 3)
-				search::easy_move.refresh_pv(*root_position, root_moves[0].pv);
+				search::easy_move().refresh_pv(*root_position, root_moves[0].pv);
 			else
-				search::easy_move.clear();
+				search::easy_move().clear();
 		}
 	}
 
 	if (!main_thread)
 		return;
 
-	if (search::easy_move.third_move_stable < 6 || main_thread->quick_move_played)
-		search::easy_move.clear();
+	if (search::easy_move().third_move_stable < 6 || main_thread->quick_move_played)
+		search::easy_move().clear();
 }
 
 void filter_root_moves(position& pos)
 {
-	tb_root_in_tb = false;
+	tb_root_in_tb() = false;
 	egtb::use_rule50 = uci_syzygy_50_move_rule;
-	tb_probe_depth = uci_syzygy_probe_depth;
-	tb_number = uci_syzygy_probe_limit;
+	tb_probe_depth() = uci_syzygy_probe_depth;
+	tb_number() = uci_syzygy_probe_limit;
 
-	if (tb_number > 0)
+	if (tb_number() > 0)
 	{
-		tb_number = 0;
-		tb_probe_depth = 0;
+		tb_number() = 0;
+		tb_probe_depth() = 0;
 	}
 
-	if (tb_number < pos.total_num_pieces() || pos.castling_possible(all))
+	if (tb_number() < pos.total_num_pieces() || pos.castling_possible(all))
 		return;
 
-	tb_root_in_tb = egtb::egtb_probe_dtz(pos);
+	tb_root_in_tb() = egtb::egtb_probe_dtz(pos);
 
-	if (tb_root_in_tb)
-		tb_number = 0;
+	if (tb_root_in_tb())
+		tb_number() = 0;
 
-	if (tb_root_in_tb && !egtb::use_rule50)
-		tb_score = tb_score > draw_score ? mate_score - max_ply - 1
-		: tb_score < draw_score ? -mate_score + max_ply + 1
+	if (tb_root_in_tb() && !egtb::use_rule50)
+		tb_score() = tb_score() > draw_score ? mate_score - max_ply - 1
+		: tb_score() < draw_score ? -mate_score + max_ply + 1
 		: draw_score;
 }
 
+// best move stored for pos, from the PV table if present, otherwise from the main hash
+uint32_t rootmove::move_from_hash(const position& pos)
+{
+	const auto key = pos.key() ^ pos.draw50_key();
+
+	if (const auto move = pv_table().probe(key))
+		return move;
+
+	main_hash_entry hash_snapshot;
+	const auto* const hash_entry = main_hash().probe(key, hash_snapshot);
+	return hash_entry ? hash_entry->move() : no_move;
+}
+
 bool rootmove::ponder_move_from_hash(position& pos)
 {
 	assert(pv.size() == 1);
@@ -1780,25 +2001,26 @@ bool rootmove::ponder_move_from_hash(position& pos)
 
 	pos.play_move(pv[0]);
 
-	if (auto * const hash_entry = main_hash.probe(pos.key() ^ pos.draw50_key()); hash_entry)
-	{
-		if (const auto move = hash_entry->move(); legal_moves_list_contains_move(pos, move))
-			pv.add(move);
-	}
+	if (const auto move = move_from_hash(pos); move && legal_moves_list_contains_move(pos, move))
+		pv.add(move);
 	pos.take_move_back(pv[0]);
 
 	return pv.size() > 1;
 }
 
 std::string print_pv(const position& pos, const int alpha, const int beta, const int active_pv, const int active_move)
+{
+	return print_pv(pos, pos.my_thread()->root_moves, alpha, beta, active_pv, active_move);
+}
+
+std::string print_pv(const position& pos, const rootmoves& root_moves, const int alpha, const int beta, const int active_pv, const int active_move)
 {
 	std::stringstream ss;
-	const auto elapsed = static_cast<int>(time_control.elapsed()) + 1;
-	const auto& root_moves = pos.my_thread()->root_moves;
-	const auto multi_pv = std::min(thread_pool.multi_pv, root_moves.move_number);
-	const auto visited_nodes = thread_pool.visited_nodes();
-	const auto tb_hits = thread_pool.tb_hits();
-	const auto hash_full = elapsed > 1000 ? main_hash.hash_full() : 0;
+	const auto elapsed = static_cast<int>(time_control().elapsed()) + 1;
+	const auto multi_pv = std::min(thread_pool().multi_pv, root_moves.move_number);
+	const auto visited_nodes = thread_pool().visited_nodes();
+	const auto tb_hits = thread_pool().tb_hits();
+	const auto hash_full = elapsed > 1000 ? main_hash().hash_full() : 0;
 
 	for (auto i = 0; i < multi_pv; ++i)
 	{
@@ -1810,14 +2032,14 @@ std::string print_pv(const position& pos, const int alpha, const int beta, const
 
 		auto val = i <= active_pv ? root_move.score : root_move.previous_score;
 
-		const auto tb = tb_root_in_tb && abs(val) < egtb_win_score;
-		val = tb ? tb_score : val;
+		const auto tb = tb_root_in_tb() && abs(val) < egtb_win_score;
+		val = tb ? tb_score() : val;
 
 		if (ss.rdbuf()->in_avail())
 			ss << "\n";
 
 		auto sel_depth = 0;
-		auto* const pi = thread_pool.main()->root_position->info();
+		auto* const pi = thread_pool().main()->root_position->info();
 		for (sel_depth = 0; sel_depth < max_ply; sel_depth++)
 			if ((pi + sel_depth)->pawn_key == 0)
 				break;
@@ -1876,10 +2098,7 @@ void rootmove::pv_from_hash(position& pos)
 
 		keys[number++] = key;
 
-		auto* const hash_entry = main_hash.probe(pos.key() ^ pos.draw50_key());
-		if (!hash_entry)
-			break;
-		move = hash_entry->move();
+		move = move_from_hash(pos);
 		if (!move || !legal_moves_list_contains_move(pos, move))
 			break;
 		pv.add(move);
@@ -1895,7 +2114,7 @@ std::string value(int val)
 	if (abs(val) < longest_mate_score)
 	{
 		if (abs(val) < win_score)
-			val -= thread_pool.root_contempt_value;
+			val -= thread_pool().root_contempt_value;
 		ss << "cp " << val / 3;
 	}
 	else
@@ -1904,3 +2123,147 @@ std::string value(int val)
 	return ss.str();
 }
 
+
+namespace search
+{
+	search_counters& search_counters::operator+=(const search_counters& other)
+	{
+		pv_nodes += other.pv_nodes;
+		non_pv_nodes += other.non_pv_nodes;
+		q_nodes += other.q_nodes;
+		hash_cutoffs += other.hash_cutoffs;
+		q_hash_cutoffs += other.q_hash_cutoffs;
+		razor_tries += other.razor_tries;
+		razor_cutoffs += other.razor_cutoffs;
+		futility_cutoffs += other.futility_cutoffs;
+		null_tries += other.null_tries;
+		null_cutoffs += other.null_cutoffs;
+		prob_cut_tries += other.prob_cut_tries;
+		prob_cut_cutoffs += other.prob_cut_cutoffs;
+		futility_prunes += other.futility_prunes;
+		late_move_prunes += other.late_move_prunes;
+		see_prunes += other.see_prunes;
+		lmr_searches += other.lmr_searches;
+		lmr_researches += other.lmr_researches;
+		lmr_full_researches += other.lmr_full_researches;
+		singular_tries += other.singular_tries;
+		singular_extensions += other.singular_extensions;
+		beta_cutoffs += other.beta_cutoffs;
+		first_move_cutoffs += other.first_move_cutoffs;
+		return *this;
+	}
+
+	search_counters& search_counters::operator-=(const search_counters& other)
+	{
+		pv_nodes -= other.pv_nodes;
+		non_pv_nodes -= other.non_pv_nodes;
+		q_nodes -= other.q_nodes;
+		hash_cutoffs -= other.hash_cutoffs;
+		q_hash_cutoffs -= other.q_hash_cutoffs;
+		razor_tries -= other.razor_tries;
+		razor_cutoffs -= other.razor_cutoffs;
+		futility_cutoffs -= other.futility_cutoffs;
+		null_tries -= other.null_tries;
+		null_cutoffs -= other.null_cutoffs;
+		prob_cut_tries -= other.prob_cut_tries;
+		prob_cut_cutoffs -= other.prob_cut_cutoffs;
+		futility_prunes -= other.futility_prunes;
+		late_move_prunes -= other.late_move_prunes;
+		see_prunes -= other.see_prunes;
+		lmr_searches -= other.lmr_searches;
+		lmr_researches -= other.lmr_researches;
+		lmr_full_researches -= other.lmr_full_researches;
+		singular_tries -= other.singular_tries;
+		singular_extensions -= other.singular_extensions;
+		beta_cutoffs -= other.beta_cutoffs;
+		first_move_cutoffs -= other.first_move_cutoffs;
+		return *this;
+	}
+}
+
+namespace searchstats
+{
+	void clear()
+	{
+		for (auto i = 0; i < thread_pool().thread_count; ++i)
+			thread_pool().threads[i]->search_stats = {};
+		thread_pool().iteration_stats.clear();
+	}
+
+	// called by the main thread after each iteration: the counters of all threads are summed
+	// and the sums of the earlier iterations subtracted. helpers keep counting while this runs,
+	// so the split between iterations is approximate with more than one thread
+	void iteration_done(const int depth, const bool completed)
+	{
+		search::iteration_stats it{depth, completed, thread_pool().visited_nodes(), {}};
+		for (auto i = 0; i < thread_pool().active_thread_count; ++i)
+			it.counters += thread_pool().threads[i]->search_stats;
+
+		auto& history = thread_pool().iteration_stats;
+		for (const auto& previous : history)
+		{
+			it.nodes -= previous.nodes;
+			it.counters -= previous.counters;
+		}
+		history.push_back(it);
+
+		if (!bench_active)
+			acout() << info(it, history.size() > 1 ? &history[history.size() - 2] : nullptr) << std::endl;
+	}
+
+	// one line per iteration; the effective branching factor is the ratio of the nodes
+	// of this iteration to those of the one before
+	std::string info(const search::iteration_stats& it, const search::iteration_stats* previous)
+	{
+		const auto& c = it.counters;
+		const auto pct = [](const uint64_t part, const uint64_t whole)
+		{
+			return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+		};
+		const auto entered = c.pv_nodes + c.non_pv_nodes + c.q_nodes;
+
+		std::ostringstream ss;
+		ss << std::fixed << std::setprecision(1)
+			<< "info string searchstats depth " << it.depth << (it.completed ? "" : " (stopped)")
+			<< " nodes " << it.nodes;
+		if (previous && previous->nodes && it.completed)
+			ss << " ebf " << std::setprecision(2) << static_cast<double>(it.nodes) / static_cast<double>(previous->nodes)
+			<< std::setprecision(1);
+		ss << " pv " << c.pv_nodes
+			<< " nonpv " << c.non_pv_nodes
+			<< " qs " << c.q_nodes << " (" << pct(c.q_nodes, entered) << "%)"
+			<< " hashcut " << c.hash_cutoffs << " qhashcut " << c.q_hash_cutoffs
+			<< " razor " << c.razor_cutoffs << "/" << c.razor_tries
+			<< " futility " << c.futility_cutoffs
+			<< " null " << c.null_cutoffs << "/" << c.null_tries
+			<< " probcut " << c.prob_cut_cutoffs << "/" << c.prob_cut_tries
+			<< " prune futility " << c.futility_prunes << " lmp " << c.late_move_prunes << " see " << c.see_prunes
+			<< " lmr " << c.lmr_searches << " research " << pct(c.lmr_researches, c.lmr_searches) << "%"
+			<< " full " << pct(c.lmr_full_researches, c.lmr_searches) << "%"
+			<< " singular " << c.singular_extensions << "/" << c.singular_tries
+			<< " cutoffs " << c.beta_cutoffs << " firstmove " << pct(c.first_move_cutoffs, c.beta_cutoffs) << "%";
+		return ss.str();
+	}
+
+	// the iterations of the last search and their sum
+	std::string report()
+	{
+		const auto& history = thread_pool().iteration_stats;
+		if (history.empty())
+			return "info string searchstats no search";
+
+		std::ostringstream ss;
+		search::iteration_stats total{history.back().depth, true, 0, {}};
+		for (size_t i = 0; i < history.size(); ++i)
+		{
+			ss << info(history[i], i ? &history[i - 1] : nullptr) << std::endl;
+			total.nodes += history[i].nodes;
+			total.counters += history[i].counters;
+		}
+
+		auto line = info(total, nullptr);
+		line.replace(0, line.find(" nodes "), "info string searchstats total");
+		ss << line;
+		return ss.str();
+	}
+}
@@ -30,10 +30,6 @@ struct search_signals
 
 namespace search
 {
-	inline search_signals signals;
-	inline search_param param;
-	inline bool running;
-
 	void init();
 	void reset();
 	void adjust_time_after_ponder_hit();
@@ -95,9 +91,59 @@ namespace search
 		uint32_t pv[3];
 	};
 
-	inline easy_move_manager easy_move;
-	inline int draw[num_sides];
-	inline uint64_t previous_info_time;
+	// search state of one engine instance, see engine.h
+	struct searchstate
+	{
+		search_signals signals;
+		search_param param;
+		bool running;
+		easy_move_manager easy_move;
+		int draw[num_sides];
+		uint64_t previous_info_time;
+		int tb_number;
+		bool tb_root_in_tb;
+		int tb_probe_depth;
+		int tb_score;
+	};
+
+	// per-thread counters of where the search spends its nodes, only updated when use_search_stats is set
+	struct search_counters
+	{
+		uint64_t pv_nodes;
+		uint64_t non_pv_nodes;
+		uint64_t q_nodes;
+		uint64_t hash_cutoffs;
+		uint64_t q_hash_cutoffs;
+		uint64_t razor_tries;
+		uint64_t razor_cutoffs;
+		uint64_t futility_cutoffs;
+		uint64_t null_tries;
+		uint64_t null_cutoffs;
+		uint64_t prob_cut_tries;
+		uint64_t prob_cut_cutoffs;
+		uint64_t futility_prunes;
+		uint64_t late_move_prunes;
+		uint64_t see_prunes;
+		uint64_t lmr_searches;
+		uint64_t lmr_researches;
+		uint64_t lmr_full_researches;
+		uint64_t singular_tries;
+		uint64_t singular_extensions;
+		uint64_t beta_cutoffs;
+		uint64_t first_move_cutoffs;
+
+		search_counters& operator+=(const search_counters& other);
+		search_counters& operator-=(const search_counters& other);
+	};
+
+	// what all threads spent while the main thread searched one iteration
+	struct iteration_stats
+	{
+		int depth;
+		bool completed;
+		uint64_t nodes;
+		search_counters counters;
+	};
 
 	template <nodetype nt>
 	int alpha_beta(position& pos, int alpha, int beta, int depth, bool cut_node);
@@ -111,7 +157,7 @@ namespace search
 	void update_stats(const position& pos, bool state_check, uint32_t move, int depth, const uint32_t* quiet_moves, int quiet_number);
 	void update_stats_quiet(const position& pos, bool state_check, int depth, uint32_t* quiet_moves, int quiet_number);
 	void update_stats_minus(const position& pos, bool state_check, uint32_t move, int depth);
-	void send_time_info();
+	int send_time_info();
 	
 	inline uint8_t lm_reductions[2][2][64 * static_cast<int>(plies)][64];
 	
@@ -162,6 +208,14 @@ namespace search
 	}
 }
 
+namespace searchstats
+{
+	void clear();
+	void iteration_done(int depth, bool completed);
+	std::string info(const search::iteration_stats& it, const search::iteration_stats* previous);
+	std::string report();
+}
+
 template <int max_plus, int max_min>
 struct piece_square_stats;
 typedef piece_square_stats<24576, 24576> counter_move_values;
@@ -169,11 +223,6 @@ typedef piece_square_stats<24576, 24576> counter_move_values;
 constexpr int egtb_helpful = 0 * plies;
 constexpr int egtb_not_helpful = 10 * plies;
 
-inline int tb_number;
-inline bool tb_root_in_tb;
-inline int tb_probe_depth;
-inline int tb_score;
-
 typedef int (*egtb_probe)(position& pos);
 void filter_root_moves(position& pos);
 std::string value(int val);
@@ -200,6 +249,7 @@ struct rootmove
 
 	bool ponder_move_from_hash(position& pos);
 	void pv_from_hash(position& pos);
+	static uint32_t move_from_hash(const position& pos);
 
 	int depth = depth_0;
 	int score = -max_score;
@@ -244,6 +294,8 @@ struct rootmoves
 	}
 };
 
+std::string print_pv(const position& pos, const rootmoves& root_moves, int alpha, int beta, int active_pv, int active_move);
+
 namespace egtb
 {
 	extern int max_pieces_wdl, max_pieces_dtz, max_pieces_dtm;
@@ -16,27 +16,107 @@
 
 #include "thread.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 
+#include "engine.h"
 #include "fire.h"
 #include "search.h"
 #include "uci.h"
 
-cmhinfo* cmh_data;
+// start the native thread; it is ready once it has set up its threadinfo and gone idle,
+// which callers wait for with wait_for_search_to_end, so several threads can start up together
+thread::thread(const int index) : engine_(this_engine), exit_(false), search_active_(true), thread_index_(index)
+{
+	counter = &engine_->thread_pool.counters[index];
+	native_thread_ = std::thread(&thread::idle_loop, this);
+}
 
-thread::thread() : exit_(false), search_active_(true), thread_index_(thread_pool.thread_count)
+thread::~thread()
 {
-	std::unique_lock lk(mutex_);
+	mutex_.lock();
+	exit_ = true;
+	sleep_condition_.notify_one();
+	mutex_.unlock();
+	native_thread_.join();
+}
 
-	native_thread_ = std::thread(&thread::idle_loop, this);
-	sleep_condition_.wait(lk, [&]
+// wake the helpers of a search together; each one counts itself off in helper_search_ended
+void threadpool::start_helpers()
+{
+	helpers_searching = active_thread_count - 1;
+	for (auto i = 1; i < active_thread_count; ++i)
+		threads[i]->wake(true);
+}
+
+void threadpool::helper_search_ended()
+{
+	if (helpers_searching.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::lock_guard lk(helpers_mutex);
+		helpers_done.notify_one();
+	}
+}
+
+// stop barrier: spin, then park until the last helper has gone idle
+void threadpool::wait_for_helpers()
+{
+	const auto deadline = now_us() + spin_wait;
+	while (helpers_searching.load(std::memory_order_acquire) && now_us() < deadline)
+		cpu_relax();
+
+	std::unique_lock lk(helpers_mutex);
+	helpers_done.wait(lk, [&]
 		{
-			return !search_active_;
+			return helpers_searching.load(std::memory_order_acquire) == 0;
 		});
 }
 
-thread::~thread()
+void threadpool::first_node_reached()
+{
+	const auto elapsed = now_us() - go_time;
+	auto slowest = first_node_latency.load(std::memory_order_relaxed);
+	while (elapsed > slowest && !first_node_latency.compare_exchange_weak(slowest, elapsed))
+	{
+	}
+}
+
+// remember when the search was first asked to stop
+void threadpool::mark_stop()
+{
+	int64_t none = 0;
+	stop_time.compare_exchange_strong(none, now_us());
+}
+
+void threadpool::record_latency()
+{
+	const auto go = static_cast<uint64_t>(first_node_latency.load());
+	const auto stop = static_cast<uint64_t>(now_us() - stop_time.load());
+	latency.searches++;
+	latency.go_total += go;
+	latency.go_max = std::max(latency.go_max, go);
+	latency.stop_total += stop;
+	latency.stop_max = std::max(latency.stop_max, stop);
+}
+
+std::string threadpool::latency_info() const
+{
+	const auto searches = std::max(latency.searches, uint64_t{1});
+	std::ostringstream ss;
+	ss << "info string latency searches " << latency.searches
+		<< " go avg " << latency.go_total / searches << " max " << latency.go_max
+		<< " stop avg " << latency.stop_total / searches << " max " << latency.stop_max << " us";
+	return ss.str();
+}
+
+timerthread::timerthread() : engine_(this_engine)
+{
+	native_thread_ = std::thread(&timerthread::idle_loop, this);
+}
+
+timerthread::~timerthread()
 {
 	mutex_.lock();
 	exit_ = true;
@@ -45,12 +125,42 @@ thread::~thread()
 	native_thread_.join();
 }
 
-void threadpool::init()
+// while watching, wake when send_time_info says the next check is due. a check runs under the mutex,
+// so once watch(false) returns no info line or stop from the finished search can follow
+void timerthread::idle_loop()
+{
+	this_engine = engine_;
+	auto interval = 1;
+
+	std::unique_lock lk(mutex_);
+	while (!exit_)
+	{
+		if (!watching_)
+		{
+			sleep_condition_.wait(lk);
+			interval = 1;
+			continue;
+		}
+
+		sleep_condition_.wait_for(lk, std::chrono::milliseconds(interval));
+		if (watching_ && !exit_)
+			interval = search::send_time_info();
+	}
+}
+
+void timerthread::watch(const bool active)
 {
-	cmh_data = static_cast<cmhinfo*>(calloc(sizeof(cmhinfo), true));
+	std::lock_guard lk(mutex_);
+	watching_ = active;
+	sleep_condition_.notify_one();
+}
 
+void threadpool::init()
+{
+	timer = new timerthread;
 	threads[0] = new mainthread;
-	thread_count = 1;
+	threads[0]->wait_for_search_to_end();
+	thread_count = pooled_count = 1;
 	end_games.init_endgames();
 	end_games.init_scale_factors();	
 	change_thread_count(thread_count);
@@ -61,49 +171,89 @@ void threadpool::init()
 
 void threadpool::begin_search(position& pos, const search_param& time)
 {
+	go_time = now_us();
 	main()->wait_for_search_to_end();
 
-	search::signals.stop_if_ponder_hit = search::signals.stop_analyzing = false;
-	search::param = time;
+	if (cmh_merge)
+		merge_counter_move_history();
+
+	search::signals().stop_if_ponder_hit = search::signals().stop_analyzing = false;
+	search::param() = time;
+	stop_time = first_node_latency = 0;
+
+	node_limited = time.nodes != 0;
+	node_budget = static_cast<int64_t>(time.nodes);
+	node_chunk = std::clamp(node_budget / (thread_count * 64), static_cast<int64_t>(16), static_cast<int64_t>(512));
+	// without a node limit the quota is never reached, so the search checks only the quota
+	for (auto i = 0; i < thread_count; ++i)
+	{
+		counters[i].reset();
+		threads[i]->node_quota = node_limited ? 0 : UINT64_MAX;
+	}
+
+	if constexpr (use_search_stats)
+		searchstats::clear();
 
 	root_position = &pos;
 
 	main()->wake(true);
 }
 
-void threadpool::delete_counter_move_history()
+void threadpool::delete_counter_move_history() const
 {
-	cmh_data->counter_move_stats.clear();
+	for (auto* table : cmh_tables)
+		if (table)
+			table->counter_move_stats.clear();
 }
 
+// activate num_threads threads. threads beyond that are parked with their threadinfo rather than deleted,
+// so growing again costs nothing; missing threads are created together and set up their threadinfo concurrently
 void threadpool::change_thread_count(int const num_threads)
 {
-	assert(uci_threads > 0);
+	assert(num_threads > 0);
+
+	const auto first_new = pooled_count;
+	while (pooled_count < num_threads)
+	{
+		threads[pooled_count] = new thread(pooled_count);
+		pooled_count++;
+	}
 
-	while (thread_count < num_threads)
-		threads[thread_count++] = new thread;
+	for (auto i = first_new; i < pooled_count; ++i)
+		threads[i]->wait_for_search_to_end();
 
-	while (thread_count > num_threads)
-		delete threads[--thread_count];
+	thread_count = num_threads;
+	share_counter_move_history(cmh_sharing);
 }
 
 void threadpool::exit()
 {
-	while (thread_count > 0)
-		delete threads[--thread_count];
+	while (pooled_count > 0)
+		delete threads[--pooled_count];
+	thread_count = 0;
+
+	delete timer;
+	timer = nullptr;
 
-	free(cmh_data);
+	for (auto* table : cmh_tables)
+		free(table);
+	cmh_tables.clear();
 }
 
 void thread::idle_loop()
 {
-	cmhi = cmh_data;
+	this_engine = engine_;
+
+	// pin first, so the memset below places the pages of threadinfo on this thread's node
+	if (thread_pool().binding != bind_none)
+		numa::bind_thread(thread_index_, thread_pool().binding);
 
 	auto* p = calloc(sizeof(threadinfo), true);
 	std::memset(p, 0, sizeof(threadinfo));
 	ti = new(p) threadinfo;
 
 	root_position = &ti->root_position;
+	auto searched = false;
 
 	while (!exit_)
 	{
@@ -111,6 +261,21 @@ void thread::idle_loop()
 
 		search_active_ = false;
 
+		if (searched && thread_index_)
+			thread_pool().helper_search_ended();
+		searched = false;
+
+		// spin a while before parking, so an early wake up does not pay for a futex sleep
+		if (thread_pool().spin_wait)
+		{
+			sleep_condition_.notify_one();
+			lk.unlock();
+			const auto deadline = now_us() + thread_pool().spin_wait;
+			while (!search_active_.load(std::memory_order_acquire) && now_us() < deadline)
+				cpu_relax();
+			lk.lock();
+		}
+
 		while (!search_active_ && !exit_)
 		{
 			sleep_condition_.notify_one();
@@ -119,8 +284,19 @@ void thread::idle_loop()
 
 		lk.unlock();
 
-		if (!exit_)
+		if (exit_)
+			break;
+
+		if (job_)
+		{
+			job_();
+			job_ = nullptr;
+		}
+		else
+		{
 			begin_search();
+			searched = true;
+		}
 	}
 
 	free(p);
@@ -130,7 +306,7 @@ uint64_t threadpool::tb_hits() const
 {
 	uint64_t hits = 0;
 	for (auto i = 0; i < active_thread_count; ++i)
-		hits += threads[i]->root_position->tb_hits();
+		hits += counters[i].tb_hits.load(std::memory_order_relaxed);
 	return hits;
 }
 
@@ -152,6 +328,24 @@ void thread::wait_for_search_to_end()
 		});
 }
 
+// run a job instead of a search the next time this thread wakes up
+void thread::execute(std::function<void()> job)
+{
+	wait_for_search_to_end();
+
+	std::unique_lock lk(mutex_);
+	job_ = std::move(job);
+	search_active_ = true;
+	sleep_condition_.notify_one();
+}
+
+// pin the calling thread by the pool's binding mode and move its search state to its node
+void thread::bind() const
+{
+	numa::bind_thread(thread_index_, thread_pool().binding);
+	numa::place(ti, sizeof(threadinfo), numa_local);
+}
+
 void thread::wake(const bool activate_search)
 {
 	std::unique_lock lk(mutex_);
@@ -162,12 +356,208 @@ void thread::wake(const bool activate_search)
 	sleep_condition_.notify_one();
 }
 
+// split [0, count) into one slice per thread and run job(begin, end) on all threads concurrently.
+// while a search is running its threads cannot take jobs, so the caller then runs the whole range
+void threadpool::parallel_for(const size_t count, const std::function<void(size_t, size_t)>& job) const
+{
+	if (thread_count < 2 || std::any_of(threads, threads + thread_count, [](const thread* th)
+		{
+			return th->searching();
+		}))
+	{
+		job(0, count);
+		return;
+	}
+
+	const auto slices = static_cast<size_t>(thread_count);
+	for (auto i = 0; i < thread_count; ++i)
+	{
+		const auto begin = count * i / slices;
+		const auto end = count * (i + 1) / slices;
+		threads[i]->execute([&job, begin, end]
+			{
+				job(begin, end);
+			});
+	}
+
+	for (auto i = 0; i < thread_count; ++i)
+		threads[i]->wait_for_search_to_end();
+}
+
+// give the thread the next chunk of the node budget, or stop the search when it is spent. each thread
+// searches at most its granted nodes plus the quiescence tail below its last check, so the total stays
+// within a small overshoot of the limit whatever the thread count
+bool threadpool::claim_nodes(thread* th)
+{
+	auto budget = node_budget.load(std::memory_order_relaxed);
+	int64_t grant;
+	do
+	{
+		if (budget <= 0)
+		{
+			mark_stop();
+			search::signals().stop_analyzing = true;
+			main()->wake(false);
+			return false;
+		}
+		grant = std::min(budget, node_chunk);
+	} while (!node_budget.compare_exchange_weak(budget, budget - grant, std::memory_order_relaxed));
+
+	th->node_quota = th->counter->nodes.load(std::memory_order_relaxed) + grant;
+	return true;
+}
+
 uint64_t threadpool::visited_nodes() const
 {
 	uint64_t nodes = 0;
 	for (auto i = 0; i < active_thread_count; ++i)
-		nodes += threads[i]->root_position->visited_nodes();
+		nodes += counters[i].nodes.load(std::memory_order_relaxed);
 	return nodes;
 }
 
-threadpool thread_pool;
\ No newline at end of file
+// re-pin all threads, parked ones included, after the binding mode changed, each thread moving its own threadinfo
+void threadpool::bind_threads(const bindingmode mode)
+{
+	binding = mode;
+
+	for (auto i = 0; i < pooled_count; ++i)
+	{
+		auto* th = threads[i];
+		th->execute([th]
+			{
+				th->bind();
+			});
+	}
+
+	for (auto i = 0; i < pooled_count; ++i)
+		threads[i]->wait_for_search_to_end();
+}
+
+// give every thread its counter move history: one table for all threads, one per NUMA node or one per thread.
+// private tables keep the history updates of one thread from bouncing cache lines between cores.
+// a table is allocated and first touched by the first thread using it, so it lands on that thread's node
+void threadpool::share_counter_move_history(const cmhsharing mode)
+{
+	if (mode != cmh_sharing)
+	{
+		for (auto* table : cmh_tables)
+			free(table);
+		cmh_tables.clear();
+		cmh_sharing = mode;
+	}
+
+	const auto tables = static_cast<size_t>(mode == cmh_thread ? thread_count : mode == cmh_node ? numa::node_count() : 1);
+	while (cmh_tables.size() > tables)
+	{
+		free(cmh_tables.back());
+		cmh_tables.pop_back();
+	}
+	cmh_tables.resize(tables, nullptr);
+
+	for (auto i = 0; i < thread_count; ++i)
+	{
+		const auto index = mode == cmh_thread ? i : mode == cmh_node ? numa::thread_node(i) : 0;
+		auto* th = threads[i];
+
+		if (!cmh_tables[index])
+		{
+			auto** table = &cmh_tables[index];
+			th->execute([table]
+				{
+					auto* p = calloc(sizeof(cmhinfo), true);
+					std::memset(p, 0, sizeof(cmhinfo));
+					*table = static_cast<cmhinfo*>(p);
+				});
+			th->wait_for_search_to_end();
+		}
+		th->cmhi = cmh_tables[index];
+	}
+
+	// a node no thread runs on (fewer threads than nodes, or a node without cpus) keeps no table
+	for (auto& table : cmh_tables)
+		if (table && std::none_of(threads, threads + thread_count, [table](const thread* th) { return th->cmhi == table; }))
+		{
+			free(table);
+			table = nullptr;
+		}
+}
+
+// average all counter move history tables, so separate tables still share what each thread learned
+void threadpool::merge_counter_move_history() const
+{
+	const auto tables = static_cast<int>(std::count_if(cmh_tables.begin(), cmh_tables.end(), [](const cmhinfo* table) { return table != nullptr; }));
+	if (tables < 2)
+		return;
+
+	constexpr auto values = sizeof(counter_move_history) / sizeof(int16_t);
+
+	parallel_for(values, [this, tables](const size_t begin, const size_t end)
+		{
+			for (auto v = begin; v < end; ++v)
+			{
+				auto sum = 0;
+				for (const auto* table : cmh_tables)
+					if (table)
+						sum += reinterpret_cast<const int16_t*>(&table->counter_move_stats)[v];
+				for (auto* table : cmh_tables)
+					if (table)
+						reinterpret_cast<int16_t*>(&table->counter_move_stats)[v] = static_cast<int16_t>(sum / tables);
+			}
+		});
+}
+
+// store the root moves of a thread splitting multipv: its first lines are exact,
+// its other moves are below them and so below the merged lines as well
+void threadpool::publish_split_moves(const rootmoves& moves, const int lines)
+{
+	std::lock_guard lk(split_mutex);
+
+	for (auto i = 0; i < moves.move_number; ++i)
+	{
+		if (const auto index = split_moves.find(moves[i].pv[0]); index >= 0)
+		{
+			split_moves[index] = moves[i];
+			if (i >= lines)
+				split_moves[index].score = -max_score;
+		}
+	}
+}
+
+// the root moves of all threads splitting multipv, best first
+rootmoves threadpool::merged_split_moves()
+{
+	std::lock_guard lk(split_mutex);
+
+	auto merged = split_moves;
+	std::stable_sort(merged.moves, merged.moves + merged.move_number);
+	return merged;
+}
+
+cmhsharing cmh_sharing_from_string(const std::string& str)
+{
+	if (str == "node")
+		return cmh_node;
+	if (str == "thread")
+		return cmh_thread;
+	return cmh_shared;
+}
+
+const char* cmh_sharing_name(const cmhsharing mode)
+{
+	switch (mode)
+	{
+	case cmh_node: return "node";
+	case cmh_thread: return "thread";
+	default: return "shared";
+	}
+}
+
+smpmode smp_mode_from_string(const std::string& str)
+{
+	return str == "abdada" ? smp_abdada : smp_lazy;
+}
+
+const char* smp_mode_name(const smpmode mode)
+{
+	return mode == smp_abdada ? "abdada" : "lazy";
+}
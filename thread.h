@@ -17,40 +17,91 @@
 #pragma once
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
 #include "fire.h"
 
 #include "endgame.h"
+#include "hash.h"
 #include "material.h"
 #include "movepick.h"
 #include "mutex.h"
+#include "numa.h"
 #include "pawn.h"
 #include "position.h"
 #include "search.h"
 
+// how the counter move history is shared between search threads
+enum cmhsharing : uint8_t
+{
+	cmh_shared,
+	cmh_node,
+	cmh_thread
+};
+
+cmhsharing cmh_sharing_from_string(const std::string& str);
+const char* cmh_sharing_name(cmhsharing mode);
+
+// how the search threads cooperate: independent lazy smp searches sharing only the hash,
+// or abdada, where threads also defer moves that another thread is already searching
+enum smpmode : uint8_t
+{
+	smp_lazy,
+	smp_abdada
+};
+
+smpmode smp_mode_from_string(const std::string& str);
+const char* smp_mode_name(smpmode mode);
+
+struct engine;
+
 class thread
 {
 	std::thread native_thread_;
+	engine* engine_;
 	Mutex mutex_;
 	ConditionVariable sleep_condition_;
-	bool exit_, search_active_;
+	bool exit_;
+	std::atomic_bool search_active_;
 	int thread_index_;
+	std::function<void()> job_;
 
 public:
-	thread();
+	explicit thread(int index);
 	virtual ~thread();
 	virtual void begin_search();
 	void idle_loop();
 	void wake(bool activate_search);
 	void wait_for_search_to_end();
+
+	[[nodiscard]] bool searching() const
+	{
+		return search_active_;
+	}
+
+	[[nodiscard]] int index() const
+	{
+		return thread_index_;
+	}
+
+	[[nodiscard]] engine& instance() const
+	{
+		return *engine_;
+	}
 	void wait(const std::atomic_bool& condition);
+	void execute(std::function<void()> job);
+	void bind() const;
 
 	threadinfo* ti{};
 	cmhinfo* cmhi{};
 	position* root_position{};
+	threadcounter* counter{};
+	uint64_t node_quota{};
+	search::search_counters search_stats{};
 
 	rootmoves root_moves;
 	int completed_depth = no_depth;
@@ -75,28 +126,60 @@ struct threadinfo
 	move_value_stats capture_history{};
 	material::material_hash material_table{};
 	pawn::pawn_hash pawn_table{};
+	q_search_hash q_search_table{};
+};
+
+// state of the main thread's quick move check; the timer thread stops a check that takes too long
+enum quickmovestate : int
+{
+	quick_move_idle,
+	quick_move_busy,
+	quick_move_stopped
 };
 
 struct mainthread final : thread
 {
+	mainthread() : thread(0)
+	{
+	}
+
 	void begin_search() override;
-	bool quick_move_allow = false, quick_move_played = false, quick_move_evaluation_busy = false;
-	bool quick_move_evaluation_stopped = false, failed_low = false;
+	bool quick_move_allow = false, quick_move_played = false, failed_low = false;
+	std::atomic_int quick_move_evaluation{quick_move_idle};
 	int best_move_changed = 0;
 	int previous_root_score = score_0;
-	int interrupt_counter = 0;
 	int previous_root_depth = {};
 };
 
+// watches the clock while a search runs: stops it at its time or node limit, stops an overlong quick move
+// check and sends the periodic info line, so the search threads never poll the clock themselves
+class timerthread
+{
+	std::thread native_thread_;
+	Mutex mutex_;
+	ConditionVariable sleep_condition_;
+	engine* engine_;
+	bool exit_ = false, watching_ = false;
+
+public:
+	timerthread();
+	~timerthread();
+	void idle_loop();
+	void watch(bool active);
+};
+
 struct threadpool : std::vector<thread*>
 {
 	void init();
 	void exit();
 
 	int thread_count{};
+	int pooled_count{};
 	time_point start{};
 	int total_analyze_time{};
 	thread* threads[max_threads]{};
+	threadcounter counters[max_threads]{};
+	timerthread* timer{};
 
 	[[nodiscard]] mainthread* main() const
 	{
@@ -104,10 +187,32 @@ struct threadpool : std::vector<thread*>
 	}
 	void begin_search(position&, const search_param&);
 	void change_thread_count(int num_threads);
+	void parallel_for(size_t count, const std::function<void(size_t, size_t)>& job) const;
+	void bind_threads(bindingmode mode);
+	void share_counter_move_history(cmhsharing mode);
+	void merge_counter_move_history() const;
 	[[nodiscard]] uint64_t visited_nodes() const;
 	[[nodiscard]] uint64_t tb_hits() const;
-	static void delete_counter_move_history();
-
+	bool claim_nodes(thread* th);
+	void delete_counter_move_history() const;
+	void start_helpers();
+	void helper_search_ended();
+	void wait_for_helpers();
+	void first_node_reached();
+	void mark_stop();
+	void record_latency();
+	[[nodiscard]] std::string latency_info() const;
+	void publish_split_moves(const rootmoves& moves, int lines);
+	[[nodiscard]] rootmoves merged_split_moves();
+
+	// a 'go nodes' search hands its nodes out to the threads in chunks, small enough
+	// that the chunks left unspent when it stops are a small part of the budget
+	int64_t node_chunk{};
+	bool node_limited{};
+	std::atomic<int64_t> node_budget{};
+
+	// per iteration search counters of the last search, built with searchstats=yes
+	std::vector<search::iteration_stats> iteration_stats;
 	int active_thread_count{};
 	side contempt_color = num_sides;
 	int piece_contempt{};
@@ -117,9 +222,32 @@ struct threadpool : std::vector<thread*>
 	rootmoves root_moves;
 	position_info* root_position_info{};
 	bool analysis_mode{};
+	bool mate_search{};
 	int fifty_move_distance{};
 	int multi_pv{}, multi_pv_max{};
+	bool multi_pv_split{};
+	int split_threads{};
+	rootmoves split_moves;
+	Mutex split_mutex;
+	bool q_search_cache{};
+	bindingmode binding = bind_none;
+	cmhsharing cmh_sharing = cmh_shared;
+	smpmode smp_mode = smp_lazy;
+	bool cmh_merge{};
+	std::vector<cmhinfo*> cmh_tables;
 	bool dummy_null_move_threat{}, dummy_prob_cut{};
-};
 
-extern threadpool thread_pool;
+	// idle threads and the main thread waiting for the helpers spin this many microseconds before they park
+	int spin_wait{};
+	std::atomic_int helpers_searching{};
+	Mutex helpers_mutex;
+	ConditionVariable helpers_done;
+
+	// go to first node (slowest thread) and stop to bestmove latencies in microseconds
+	int64_t go_time{};
+	std::atomic<int64_t> stop_time{}, first_node_latency{};
+	struct
+	{
+		uint64_t searches, go_total, go_max, stop_total, stop_max;
+	} latency{};
+};
@@ -16,41 +16,70 @@
 
 #include "uci.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "evaluate.h"
 #include "fire.h"
 #include "hash.h"
+#include "numa.h"
 #include "random/random.h"
 #include "search.h"
 #include "thread.h"
+#include "util/analyze.h"
 #include "util/perft.h"
 #include "util/util.h"
 
 // stop threads, reset search
+namespace
+{
+	// the last position command. the uci position keeps its history in the main thread's threadinfo, and while
+	// no other command has used that, a position command extending the same game only plays the new moves
+	struct positioncache
+	{
+		bool valid = false;
+		std::string fen;
+		std::vector<std::string> moves;
+		std::vector<uint64_t> keys;
+	} last_position;
+
+	// end a running search like 'stop' and wait for its bestmove, so the hash is not cleared or
+	// reallocated under the searching threads
+	void stop_search()
+	{
+		if (thread_pool().main()->searching())
+		{
+			thread_pool().mark_stop();
+			search::signals().stop_analyzing = true;
+			thread_pool().main()->wake(false);
+		}
+		thread_pool().main()->wait_for_search_to_end();
+	}
+}
+
 void new_game()
 {
-	search::signals.stop_analyzing = true;
-	thread_pool.main()->wake(false);
-	thread_pool.main()->wait_for_search_to_end();
+	stop_search();
 	search::reset();
+	if constexpr (use_hash_stats)
+		hashstats::clear();
 }
 
-// initialize system
+// initialize the process wide tables, then the main engine instance
 void init(const int hash_size)
 {
-	thread_pool.start = now();
+	numa::init();
 	bitboard::init();
 	position::init();
 	search::init();
 	evaluate::init();
 	pawn::init();
-	thread_pool.init();
-	search::reset();
-	main_hash.init(hash_size);
+	main_engine.init(hash_size);
 }
 
 // create infinite loop while parsing for UCI input stream tokens (words)
@@ -59,7 +88,7 @@ void uci_loop(const int argc, char* argv[])
 	position pos{};
 	std::string token, cmd;
 
-	pos.set(startpos, uci_chess960, thread_pool.main());
+	pos.set(startpos, uci_chess960, thread_pool().main());
 	new_game();
 
 	for (auto i = 1; i < argc; ++i)
@@ -78,6 +107,9 @@ void uci_loop(const int argc, char* argv[])
 
 		token.clear();
 		is >> std::skipws >> token;
+
+		if (token != "position" && token != "go" && token != "stop" && token != "ponderhit" && token != "isready")
+			last_position.valid = false;
 		
 		// check for significant UCI tokens
 		if (token == "uci")
@@ -85,16 +117,31 @@ void uci_loop(const int argc, char* argv[])
 			acout() << "id name " << program << " " << version << " " << platform << " " << bmis << std::endl;
 			acout() << "id author " << author << std::endl;
 			acout() << "option name Hash type spin default 64 min 16 max 1048576" << std::endl;
-			acout() << "option name Threads type spin default 1 min 1 max 128" << std::endl;
+			acout() << "option name Threads type spin default 1 min 1 max 512" << std::endl;
 			acout() << "option name MultiPV type spin default 1 min 1 max 64" << std::endl;
 			acout() << "option name Contempt type spin default 0 min -100 max 100" << std::endl;	
 			acout() << "option name SyzygyProbeDepth type spin default 1 min 0 max 64" << std::endl;
 			acout() << "option name SyzygyProbeLimit type spin default 6 min 0 max 6" << std::endl;
 			acout() << "option name SearchType type combo default alphabeta var alphabeta var random" << std::endl;
+			acout() << "option name NumaPolicy type combo default off var off var interleave var local" << std::endl;
+			acout() << "option name ThreadBinding type combo default none var none var core var node" << std::endl;
+			acout() << "option name CounterMoveHistory type combo default shared var shared var node var thread" << std::endl;
+			acout() << "option name SMPMode type combo default lazy var lazy var abdada" << std::endl;
+			acout() << "option name SpinWait type spin default 0 min 0 max 100000" << std::endl;
+			acout() << "option name MateHash type spin default 64 min 1 max 65536" << std::endl;
 			
 			acout() << "option name Ponder type check default false" << std::endl;
 			acout() << "option name UCI_Chess960 type check default false" << std::endl;
 			acout() << "option name ClearHash type button" << std::endl;			
+			acout() << "option name LargePages type check default true" << std::endl;
+			acout() << "option name QSearchCache type check default false" << std::endl;
+			acout() << "option name MateSolver type check default true" << std::endl;
+			acout() << "option name CounterMoveMerge type check default false" << std::endl;
+			acout() << "option name MultiPVSplit type check default false" << std::endl;
+			acout() << "option name HashFile type string default fire.hsh" << std::endl;
+			acout() << "option name SaveHash type button" << std::endl;
+			acout() << "option name LoadHash type button" << std::endl;
+			acout() << "option name SharedHash type string default <empty>" << std::endl;
 			acout() << "option name Syzygy50MoveRule type check default true" << std::endl;
 			acout() << "option name SyzygyPath type string default <empty>" << std::endl;
 
@@ -122,8 +169,21 @@ void uci_loop(const int argc, char* argv[])
 		}
 		else if (token == "stop")
 		{
-			search::signals.stop_analyzing = true;
-			thread_pool.main()->wake(false);
+			thread_pool().mark_stop();
+			search::signals().stop_analyzing = true;
+			thread_pool().main()->wake(false);
+		}
+		else if (token == "ponderhit")
+		{
+			// the opponent played the expected move: continue as a normal search, or stop if it is already done
+			search::param().ponder = 0;
+			search::adjust_time_after_ponder_hit();
+			if (search::signals().stop_if_ponder_hit)
+			{
+				thread_pool().mark_stop();
+				search::signals().stop_analyzing = true;
+				thread_pool().main()->wake(false);
+			}
 		}
 		else if (token == "quit")
 		{
@@ -139,7 +199,7 @@ void uci_loop(const int argc, char* argv[])
 			
 			// set params or use default values
 			auto depth = is >> token ? token : "7";
-			auto hash = is >> token ? token : "64";
+			auto hash_size = is >> token ? token : "64";
 			auto threads = is >> token ? token : "1";
 
 			//parse fen words from command line and assign default values if missing
@@ -168,12 +228,102 @@ void uci_loop(const int argc, char* argv[])
 			bench(stoi(bench_depth));
 			bench_active = false;
 		}
+		else if (token == "hashstats")
+		{	// full table scan, plus probe/replace counters when built with hashstats=yes
+			thread_pool().main()->wait_for_search_to_end();
+			acout() << main_hash().occupancy() << std::endl;
+			if constexpr (use_hash_stats)
+			{
+				acout() << hashstats::info() << std::endl;
+				if (is >> token && token == "clear")
+					hashstats::clear();
+			}
+			else
+				acout() << "info string hashstats counters disabled, build with hashstats=yes" << std::endl;
+		}
+		else if (token == "searchstats")
+		{	// per iteration node type, cutoff, pruning and reduction counters of the last search
+			thread_pool().main()->wait_for_search_to_end();
+			if constexpr (use_search_stats)
+				acout() << searchstats::report() << std::endl;
+			else
+				acout() << "info string searchstats counters disabled, build with searchstats=yes" << std::endl;
+		}
+		else if (token == "hashstress")
+		{	// torn entry test on a separate table, 4 threads per logical core for 5 seconds unless specified
+			thread_pool().main()->wait_for_search_to_end();
+			auto stress_threads = is >> token ? token : std::to_string(4 * std::max(1u, std::thread::hardware_concurrency()));
+			auto stress_seconds = is >> token ? token : "5";
+			hashstats::stress(stoi(stress_threads), stoi(stress_seconds));
+		}
+		else if (token == "latency")
+		{	// go to first node and stop to bestmove latencies of the searches so far
+			thread_pool().main()->wait_for_search_to_end();
+			acout() << thread_pool().latency_info() << std::endl;
+			if (is >> token && token == "clear")
+				thread_pool().latency = {};
+		}
+		else if (token == "benchinstances")
+		{	// independent engine instances searching at once in this process, depth 12 and one per logical core unless specified
+			auto bench_depth = is >> token ? token : "12";
+			auto bench_instances_count = is >> token ? token : std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+			thread_pool().main()->wait_for_search_to_end();
+			bench_active = true;
+			bench_instances(stoi(bench_depth), std::max(1, stoi(bench_instances_count)));
+			bench_active = false;
+		}
+		else if (token == "analyze")
+		{	// batch epd analysis, several positions searched at once: analyze <file> [depth n | nodes n | movetime ms]
+			// [threads n] [instancethreads n] [out file]; depth 12 on Threads single thread instances unless specified
+			std::string file_name, limit = "depth 12", amount, out_name;
+			auto analyze_threads = uci_threads;
+			auto instance_threads = 1;
+			is >> file_name;
+			while (is >> token)
+				if (token == "depth" || token == "nodes" || token == "movetime")
+				{
+					is >> amount;
+					limit = token + " " + amount;
+				}
+				else if (token == "threads")
+					is >> analyze_threads;
+				else if (token == "instancethreads")
+					is >> instance_threads;
+				else if (token == "out")
+					is >> out_name;
+			if (out_name.empty())
+				out_name = file_name + ".analysis.epd";
+			thread_pool().main()->wait_for_search_to_end();
+			bench_active = true;
+			analyze(file_name, limit, std::min(std::max(1, analyze_threads), max_threads), instance_threads, out_name);
+			bench_active = false;
+		}
+		else if (token == "benchscale")
+		{	// nps scaling against thread count, depth 12 and all logical cores unless specified
+			auto bench_depth = is >> token ? token : "12";
+			auto bench_threads = is >> token ? token : std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+			// bench_scale changes the thread count and reallocates the hash, so a running search is ended first
+			stop_search();
+			bench_active = true;
+			bench_scale(stoi(bench_depth), std::min(stoi(bench_threads), max_threads));
+			bench_active = false;
+		}
+		else if (token == "benchmate")
+		{	// mate solver against regular search on mate problems, 10 seconds a search and the built-in problems unless specified
+			auto bench_time = is >> token ? token : "10000";
+			std::string file_name;
+			is >> file_name;
+			thread_pool().main()->wait_for_search_to_end();
+			bench_active = true;
+			bench_mate(stoi(bench_time), file_name);
+			bench_active = false;
+		}
 		else
 		{
 		}
 	} while (token != "quit" && argc == 1);
 	// if loop is broken with 'quit', exit and destroy thread pool
-	thread_pool.exit();
+	thread_pool().exit();
 }
 
 // read input stream and parse for meaningful UCI options
@@ -191,7 +341,8 @@ void set_option(std::istringstream& input)
 				input >> token;
 				input >> token;
 				uci_hash = stoi(token);
-				main_hash.init(uci_hash);
+				stop_search();
+				main_hash().resize(uci_hash);
 				acout() << "info string Hash " << uci_hash << " MB" << std::endl;
 				break;
 			}
@@ -200,7 +351,7 @@ void set_option(std::istringstream& input)
 				input >> token;
 				input >> token;
 				uci_threads = stoi(token);
-				thread_pool.change_thread_count(uci_threads);
+				thread_pool().change_thread_count(uci_threads);
 				if (uci_threads == 1)
 					acout() << "info string Threads " << uci_threads << " thread" << std::endl;
 				else
@@ -215,6 +366,18 @@ void set_option(std::istringstream& input)
 				acout() << "info string MultiPV " << uci_multipv << std::endl;
 				break;
 			}
+			if (token == "MultiPVSplit")
+			{
+				input >> token;
+				input >> token;
+				if (token == "true")
+					uci_multipv_split = true;
+				else
+					uci_multipv_split = false;
+				thread_pool().multi_pv_split = uci_multipv_split;
+				acout() << "info string MultiPVSplit " << uci_multipv_split << std::endl;
+				break;
+			}
 			if (token == "Contempt")
 			{
 				input >> token;
@@ -239,6 +402,64 @@ void set_option(std::istringstream& input)
 				acout() << "info string SyzygyProbeLimit " << uci_syzygy_probe_limit << std::endl;
 				break;
 			}
+			if (token == "NumaPolicy")
+			{
+				input >> token;
+				input >> token;
+				uci_numa_policy = token;
+				stop_search();
+				main_hash().numa_policy(numa::policy_from_string(uci_numa_policy));
+				acout() << "info string NumaPolicy " << numa::policy_name(main_hash().numa_policy()) << std::endl;
+				break;
+			}
+			if (token == "ThreadBinding")
+			{
+				input >> token;
+				input >> token;
+				uci_thread_binding = token;
+				thread_pool().bind_threads(numa::binding_from_string(uci_thread_binding));
+				acout() << "info string ThreadBinding " << numa::binding_name(thread_pool().binding) << std::endl;
+				break;
+			}
+			if (token == "CounterMoveHistory")
+			{
+				input >> token;
+				input >> token;
+				uci_counter_move_history = token;
+				thread_pool().share_counter_move_history(cmh_sharing_from_string(uci_counter_move_history));
+				acout() << "info string CounterMoveHistory " << cmh_sharing_name(thread_pool().cmh_sharing) << std::endl;
+				break;
+			}
+			if (token == "SMPMode")
+			{
+				input >> token;
+				input >> token;
+				uci_smp_mode = token;
+				thread_pool().smp_mode = smp_mode_from_string(uci_smp_mode);
+				acout() << "info string SMPMode " << smp_mode_name(thread_pool().smp_mode) << std::endl;
+				break;
+			}
+			if (token == "SpinWait")
+			{
+				input >> token;
+				input >> token;
+				uci_spin_wait = stoi(token);
+				thread_pool().spin_wait = uci_spin_wait;
+				acout() << "info string SpinWait " << uci_spin_wait << " us" << std::endl;
+				break;
+			}
+			if (token == "CounterMoveMerge")
+			{
+				input >> token;
+				input >> token;
+				if (token == "true")
+					uci_counter_move_merge = true;
+				else
+					uci_counter_move_merge = false;
+				thread_pool().cmh_merge = uci_counter_move_merge;
+				acout() << "info string CounterMoveMerge " << uci_counter_move_merge << std::endl;
+				break;
+			}
 			if (token == "SearchType")
 			{
 				input >> token;
@@ -272,8 +493,93 @@ void set_option(std::istringstream& input)
 			}
 			if (token == "ClearHash")
 			{
-				main_hash.clear();
-				acout() << "info string Hash: cleared" << std::endl;
+				stop_search();
+				pv_table().clear();
+				if (main_hash().clear())
+					acout() << "info string Hash: cleared" << std::endl;
+				else
+					acout() << "info string Hash: shared with other processes, not cleared" << std::endl;
+				break;
+			}
+			if (token == "HashFile")
+			{
+				input >> token;
+				input >> token;
+				uci_hash_file = token;
+				acout() << "info string HashFile " << uci_hash_file << std::endl;
+				break;
+			}
+			if (token == "SaveHash")
+			{
+				if (main_hash().save(uci_hash_file))
+					acout() << "info string Hash: saved to " << uci_hash_file << std::endl;
+				else
+					acout() << "info string Hash: could not save to " << uci_hash_file << std::endl;
+				break;
+			}
+			if (token == "LoadHash")
+			{
+				stop_search();
+				if (main_hash().load(uci_hash_file))
+					acout() << "info string Hash: loaded " << (main_hash().size() >> 20) << " MB from " << uci_hash_file << std::endl;
+				else
+					acout() << "info string Hash: could not load " << uci_hash_file << std::endl;
+				break;
+			}
+			if (token == "SharedHash")
+			{
+				input >> token;
+				input >> token;
+				uci_shared_hash = token == "<empty>" ? "" : token;
+				stop_search();
+				if (main_hash().share(uci_shared_hash, uci_hash))
+					acout() << "info string SharedHash " << (uci_shared_hash.empty() ? "<empty>" : uci_shared_hash) << std::endl;
+				else
+					acout() << "info string SharedHash: could not share " << uci_shared_hash << ", using a private hash" << std::endl;
+				break;
+			}
+			if (token == "LargePages")
+			{
+				input >> token;
+				input >> token;
+				if (token == "true")
+					uci_large_pages = true;
+				else
+					uci_large_pages = false;
+				stop_search();
+				main_hash().large_pages(uci_large_pages);
+				acout() << "info string LargePages " << uci_large_pages << std::endl;
+				break;
+			}
+			if (token == "QSearchCache")
+			{
+				input >> token;
+				input >> token;
+				if (token == "true")
+					uci_q_search_cache = true;
+				else
+					uci_q_search_cache = false;
+				thread_pool().q_search_cache = uci_q_search_cache;
+				acout() << "info string QSearchCache " << uci_q_search_cache << std::endl;
+				break;
+			}
+			if (token == "MateSolver")
+			{
+				input >> token;
+				input >> token;
+				if (token == "true")
+					uci_mate_solver = true;
+				else
+					uci_mate_solver = false;
+				acout() << "info string MateSolver " << uci_mate_solver << std::endl;
+				break;
+			}
+			if (token == "MateHash")
+			{
+				input >> token;
+				input >> token;
+				uci_mate_hash = stoi(token);
+				acout() << "info string MateHash " << uci_mate_hash << " MB" << std::endl;
 				break;
 			}
 			if (token == "Syzygy50MoveRule")
@@ -340,19 +646,45 @@ void go(position& pos, std::istringstream& is)
 			is >> param.depth;
 			param.infinite = 0;
 		}
+		else if (token == "nodes")
+		{
+			is >> param.nodes;
+			param.infinite = 0;
+		}
+		else if (token == "movetime")
+		{
+			is >> param.move_time;
+			param.infinite = 0;
+		}
+		else if (token == "mate")
+		{
+			is >> param.mate;
+			param.infinite = 0;
+		}
+		else if (token == "ponder")
+			param.ponder = 1;
+		else if (token == "searchmoves")
+		{
+			// the moves run to the end of the command
+			while (is >> token)
+				if (const auto move = util::move_from_string(pos, token); move != no_move)
+					param.search_moves.add(move);
+		}
 		else if (token == "infinite")
 			param.infinite = 1;
 	}
 	if (uci_search == "random")
+	{
+		last_position.valid = false;
 		random(pos);
+	}
 	else			
-		thread_pool.begin_search(pos, param);
+		thread_pool().begin_search(pos, param);
 }
 
 // convert fen to internal position representation
 void set_position(position& pos, std::istringstream& is)
 {
-	auto move = no_move;
 	std::string token, fen;
 
 	is >> token;
@@ -368,13 +700,49 @@ void set_position(position& pos, std::istringstream& is)
 	else
 		return;
 
-	pos.set(fen, false, thread_pool.main());
+	std::vector<std::string> moves;
+	while (is >> token)
+		moves.push_back(token);
+
+	// a search still running writes the history beyond its root, which is where this position continues
+	const auto searching = thread_pool().main()->searching();
+	auto& last = last_position;
+	size_t played = 0;
+
+	if (last.valid
+		&& !searching
+		&& last.fen == fen
+		&& pos.thread_info() == thread_pool().main()->ti
+		&& moves.size() >= last.moves.size()
+		&& std::equal(last.moves.begin(), last.moves.end(), moves.begin()))
+	{
+		// an analysis search clears the keys of earlier positions that did not repeat, so put them back
+		played = last.moves.size();
+		for (size_t i = 0; i <= played; ++i)
+			(pos.info() - played + i)->key = last.keys[i];
+	}
+	else
+	{
+		pos.set(fen, false, thread_pool().main());
+		last.fen = fen;
+		last.moves.clear();
+		last.keys.assign(1, pos.key());
+	}
 
-	while (is >> token && (move = util::move_from_string(pos, token)) != no_move)
+	for (auto i = played; i < moves.size(); ++i)
 	{
+		auto str = moves[i];
+		const auto move = util::move_from_string(pos, str);
+		if (move == no_move)
+			break;
+
 		pos.play_move(move);
 		pos.increase_game_ply();
+		last.moves.push_back(moves[i]);
+		last.keys.push_back(pos.key());
 	}
+
+	last.valid = !searching;
 }
 
 std::string trim(const std::string& str, const std::string& whitespace)
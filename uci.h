@@ -18,20 +18,33 @@
 #include <sstream>
 #include "position.h"
 
-// UCI option default values
-static std::string startpos = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
-static int uci_hash = 64;
-static int uci_threads = 1;
-static int uci_multipv = 1;
-static int uci_contempt = 0;
-static bool uci_ponder = false;
-static bool uci_chess960 = false;
+// UCI option values, inline so set_option and the code reading them share one copy
+inline std::string startpos = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+inline int uci_hash = 64;
+inline int uci_threads = 1;
+inline int uci_multipv = 1;
+inline bool uci_multipv_split = false;
+inline int uci_contempt = 0;
+inline bool uci_ponder = false;
+inline bool uci_chess960 = false;
+inline bool uci_large_pages = true;
+inline bool uci_q_search_cache = false;
+inline bool uci_mate_solver = true;
+inline int uci_mate_hash = 64;
 
-static bool uci_syzygy_50_move_rule = false;
-static int uci_syzygy_probe_depth = 1;
-static int uci_syzygy_probe_limit = 6;
-static std::string uci_search = "alphabeta";
-static std::string uci_syzygy_path;
+inline bool uci_syzygy_50_move_rule = false;
+inline int uci_syzygy_probe_depth = 1;
+inline int uci_syzygy_probe_limit = 6;
+inline std::string uci_search = "alphabeta";
+inline std::string uci_syzygy_path;
+inline std::string uci_numa_policy = "off";
+inline std::string uci_thread_binding = "none";
+inline std::string uci_counter_move_history = "shared";
+inline bool uci_counter_move_merge = false;
+inline std::string uci_smp_mode = "lazy";
+inline int uci_spin_wait = 0;
+inline std::string uci_hash_file = "fire.hsh";
+inline std::string uci_shared_hash;
 
 inline bool bench_active = false;
 
@@ -43,6 +56,9 @@ void set_position(position& pos, std::istringstream& is);
 void set_option(std::istringstream& input);
 void go(position& pos, std::istringstream& is);
 void bench(int depth);
+void bench_scale(int depth, int thread_limit);
+void bench_instances(int depth, int instances);
+void bench_mate(int move_time, const std::string& file);
 std::string trim(const std::string& str, const std::string& whitespace = " \t");
 std::string sq(square sq);
 std::string print_pv(const position& pos, int alpha, int beta, int active_pv, int active_move);
\ No newline at end of file
@@ -0,0 +1,228 @@
+/*
+  Fire is a freeware UCI chess playing engine authored by Norman Schmidt.
+
+  Fire utilizes many state-of-the-art chess programming ideas and techniques
+  which have been documented in detail at https://www.chessprogramming.org/
+  and demonstrated via the very strong open-source chess engine Stockfish...
+  https://github.com/official-stockfish/Stockfish.
+  
+  Fire is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or any later version.
+
+  You should have received a copy of the GNU General Public License with
+  this program: copying.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "analyze.h"
+
+#include "../engine.h"
+#include "../fire.h"
+#include "../position.h"
+#include "../search.h"
+#include "../thread.h"
+#include "../uci.h"
+#include "util.h"
+
+namespace
+{
+	// positions are read by whichever instance is free and written back in input order
+	struct batch
+	{
+		std::ifstream in;
+		std::ofstream out;
+		bool csv = false;
+		std::mutex mutex;
+		int next_read = 0;
+		int next_write = 0;
+		std::map<int, std::string> pending;
+		uint64_t nodes = 0;
+	};
+
+	// the operations of an epd line, "id \"a\"; bm e4;", less the ones the analysis writes itself
+	std::string epd_operations(std::istream& is)
+	{
+		std::string operations, operation;
+		auto quoted = false;
+		for (char c; is.get(c) || !operation.empty();)
+		{
+			// a missing ';' after the last operation is tolerated
+			if (!is)
+				c = ';';
+			if (c == '"')
+				quoted = !quoted;
+			if (c != ';' || quoted && is)
+			{
+				operation += c;
+				continue;
+			}
+
+			std::istringstream op(operation);
+			if (std::string opcode; op >> opcode && opcode != "acd" && opcode != "acn" && opcode != "ce" && opcode != "pv")
+				operations += operation.substr(operation.find_first_not_of(" \t")) + "; ";
+			operation.clear();
+		}
+		return operations;
+	}
+
+	bool next_position(batch& b, std::string& fen, std::string& operations, int& index)
+	{
+		std::lock_guard lock(b.mutex);
+		std::string line;
+		while (std::getline(b.in, line))
+		{
+			// the first four fields of an epd line are the fen, the operations after them are copied to the result
+			std::istringstream is(line);
+			std::string field;
+			fen.clear();
+			auto fields = 0;
+			while (fields < 4 && is >> field)
+			{
+				fen += field + " ";
+				++fields;
+			}
+
+			if (fields < 4 || fen[0] == '#')
+				continue;
+
+			operations = epd_operations(is);
+
+			index = b.next_read++;
+			return true;
+		}
+		return false;
+	}
+
+	void write_result(batch& b, const int index, std::string result, const uint64_t nodes)
+	{
+		std::lock_guard lock(b.mutex);
+		b.nodes += nodes;
+		b.pending.emplace(index, std::move(result));
+
+		for (auto it = b.pending.find(b.next_write); it != b.pending.end(); it = b.pending.find(b.next_write))
+		{
+			b.out << it->second << '\n';
+			b.pending.erase(it);
+			++b.next_write;
+		}
+	}
+
+	// epd centipawn evaluation, mates as 32767 less the plies to mate
+	int centipawns(int val)
+	{
+		if (abs(val) >= longest_mate_score)
+			return val > 0 ? 32767 - (mate_score - val) : -32767 + (mate_score + val);
+
+		if (abs(val) < win_score)
+			val -= thread_pool().root_contempt_value;
+		return val / 3;
+	}
+
+	// the main thread's deepest completed line, in uci notation
+	std::string result_line(const batch& b, std::string fen, const std::string& operations, position& pos)
+	{
+		const auto& root_move = thread_pool().main()->root_moves[0];
+		const auto depth = root_move.depth / main_thread_inc;
+		const auto nodes = thread_pool().visited_nodes();
+
+		std::string pv;
+		for (auto i = 0; i < root_move.pv.size() && root_move.pv[i] != no_move; ++i)
+			pv += (i ? " " : "") + util::move_to_string(root_move.pv[i], pos);
+
+		fen.pop_back();
+		std::ostringstream ss;
+		if (b.csv)
+			ss << fen << ',' << (root_move.pv[0] != no_move ? util::move_to_string(root_move.pv[0], pos) : "none") << ','
+				<< value(root_move.score) << ',' << depth << ',' << nodes << ',' << pv;
+		else
+			ss << fen << ' ' << operations << "acd " << depth << "; acn " << nodes << "; ce " << centipawns(root_move.score)
+				<< "; pv " << pv << ";";
+		return ss.str();
+	}
+}
+
+// search the positions of an epd file in several engine instances at once, each with its own slice of the hash
+// and instance_threads threads. every position gets the same limit ("depth 12", "nodes 100000", "movetime 500")
+// and starts from a cleared hash and history, so its result does not depend on the positions before it.
+// the results are written in input order, as epd operations or, for a .csv output file, as csv rows
+void analyze(const std::string& file_name, const std::string& limit, const int threads, const int instance_threads, const std::string& out_name)
+{
+	batch b;
+	b.in.open(file_name);
+	if (!b.in)
+	{
+		acout() << "info string analyze: could not open " << file_name << std::endl;
+		return;
+	}
+
+	b.out.open(out_name, std::ios::trunc);
+	if (!b.out)
+	{
+		acout() << "info string analyze: could not write " << out_name << std::endl;
+		return;
+	}
+
+	b.csv = out_name.size() >= 4 && out_name.compare(out_name.size() - 4, 4, ".csv") == 0;
+	if (b.csv)
+		b.out << "fen,bestmove,score,depth,nodes,pv" << '\n';
+
+	const auto per_instance = std::max(1, std::min(instance_threads, threads));
+	const auto instances = std::max(1, threads / per_instance);
+	const auto hash_mb = std::max(1, uci_hash / instances);
+
+	acout() << "info string analyze " << file_name << ": " << instances << " instances of " << per_instance
+		<< (per_instance == 1 ? " thread, " : " threads, ") << hash_mb << " MB hash each, " << limit << std::endl;
+
+	// the instances split the Hash budget between them, so the main table is shrunk while they run and
+	// given back its size (or its shared memory segment) afterwards, empty
+	main_hash().init(1);
+
+	const auto start_time = now();
+	std::vector<std::thread> drivers;
+
+	for (auto i = 0; i < instances; ++i)
+		drivers.emplace_back([&]
+			{
+				auto* instance = new engine;
+				instance->init(hash_mb);
+				if (per_instance > 1)
+					instance->thread_pool.change_thread_count(per_instance);
+
+				position pos{};
+				std::string fen, operations;
+				auto index = 0;
+
+				while (next_position(b, fen, operations, index))
+				{
+					search::reset();
+					pos.set(fen, uci_chess960, thread_pool().main());
+					std::istringstream is(limit);
+					go(pos, is);
+					thread_pool().main()->wait_for_search_to_end();
+					write_result(b, index, result_line(b, fen, operations, pos), thread_pool().visited_nodes());
+				}
+
+				instance->exit();
+				delete instance;
+			});
+
+	for (auto& driver : drivers)
+		driver.join();
+
+	if (!main_hash().share(uci_shared_hash, uci_hash))
+		acout() << "info string SharedHash: could not share " << uci_shared_hash << ", using a private hash" << std::endl;
+
+	const auto elapsed = static_cast<double>(now() + 1 - start_time) / 1000;
+	acout() << "info string analyze: " << b.next_write << " positions in " << std::fixed << std::setprecision(2) << elapsed
+		<< " s, " << std::setprecision(1) << b.next_write / elapsed << " positions/s, nps "
+		<< std::setprecision(0) << static_cast<double>(b.nodes) / elapsed << ", results in " << out_name << std::endl;
+}
@@ -15,42 +15,70 @@
 */
 
 #include <fstream>
+#include <thread>
 #include "bench.h"
 
+#include "../engine.h"
+#include "../hash.h"
+#include "../numa.h"
 #include "../thread.h"
 #include "../uci.h"
 #include "util.h"
 
+namespace
+{
+	// search every bench position to the given depth and return the total node count
+	uint64_t search_positions(const int depth, const bool verbose)
+	{
+		uint64_t nodes = 0;
+		auto pos_num = 0;
+		constexpr auto num_positions = static_cast<int>(std::size(bench_positions));
+		position pos{};
+
+		for (auto& bench_position : bench_positions)
+		{
+			pos_num++;
+			search::reset();
+			auto s_depth = "depth " + std::to_string(depth);
+			std::istringstream iss(s_depth);
+			pos.set(bench_position, false, thread_pool().main());
+			if (verbose)
+			{
+				acout() << "position " << pos_num << '/' << num_positions << " " << pos.fen() << std::endl;
+				acout() << pos << std::endl;
+			}
+			go(pos, iss);
+			thread_pool().main()->wait_for_search_to_end();
+			nodes += thread_pool().visited_nodes();
+		}
+		return nodes;
+	}
+
+	// time-stamped log file name, e.g. bench_Oct-16_20-10.txt
+	std::string log_name(const char* prefix)
+	{
+		char buf[256]{};
+		auto now = time(nullptr);
+		strftime(buf, 32, "%b-%d_%H-%M", localtime(&now));
+		return std::string(prefix) + "_" + buf + ".txt";
+	}
+}
+
 // search 64 positions (start position, 21 openings from ECO, 21 middlegame, 21 endgames from ECE)
 // to depth 16 and write a time-stamped results file to disk
 // this is an extremely useful function during development and code optimization efforts...to measure speedups and/or slowdowns
 // it can be started via command line 'bench', or via Bench button in your GUI's UCI dialog
 void bench(const int depth)
 {
-	static char file_name[256]{};
-	char buf[256]{};
-
-	uint64_t nodes = 0;
-	auto pos_num = 0;
 	auto num_positions = 64;
-	position pos{};
+
+	if constexpr (use_hash_stats)
+		hashstats::clear();
 
 	// start bench
 	const auto start_time = now();
 
-	for (auto& bench_position : bench_positions)
-	{
-		pos_num++;
-		search::reset();
-		auto s_depth = "depth " + std::to_string(depth);
-		std::istringstream iss(s_depth);
-		pos.set(bench_position, false, thread_pool.main());
-		acout() << "position " << pos_num << '/' << num_positions << " " << pos.fen() << std::endl;
-		acout() << pos << std::endl;
-		go(pos, iss);
-		thread_pool.main()->wait_for_search_to_end();
-		nodes += thread_pool.visited_nodes();
-	}
+	const auto nodes = search_positions(depth, true);
 
 	const auto elapsed_time = static_cast<double>(now() + 1 - start_time) / 1000;
 	const auto nps = static_cast<double>(nodes) / elapsed_time;
@@ -79,12 +107,23 @@ void bench(const int depth)
 	acout() << ss.str();
 	ss.str(std::string());
 
-	// calculate time stamp for file name
-	auto now = time(nullptr);
-	strftime(buf, 32, "%b-%d_%H-%M", localtime(&now));
+	// transposition table layout, and hit rate when built with 'make hashstats=yes'
+	const auto hc = hashstats::total();
+	const auto hit_rate = hc.probes ? 100.0 * static_cast<double>(hc.hits) / static_cast<double>(hc.probes) : 0.0;
+	const auto q_hit_rate = hc.q_probes ? 100.0 * static_cast<double>(hc.q_hits) / static_cast<double>(hc.q_probes) : 0.0;
+	acout() << "hash layout " << hash::layout_name() << std::endl;
+	if constexpr (use_hash_stats)
+	{
+		ss.precision(1);
+		ss << "hash hits " << std::fixed << hit_rate << "%" << std::endl;
+		if (hc.q_probes)
+			ss << "qcache hits " << std::fixed << q_hit_rate << "%" << std::endl;
+		acout() << ss.str();
+		ss.str(std::string());
+	}
 
-	// copy time stamp string to file name
-	sprintf(file_name, "bench_%s.txt", buf);
+	// time-stamped file name
+	const auto file_name = log_name("bench");
 	acout() << "\nsaved " << file_name << std::endl << std::endl;
 
 	// create stream & open log file for writing
@@ -98,7 +137,261 @@ void bench(const int depth)
 	bench_log << "time " << std::fixed << std::setprecision(2) << elapsed_time << " secs" << std::endl;
 	bench_log << "nps " << std::fixed << std::setprecision(0) << nps << std::endl;
 	bench_log << "ttd " << std::fixed << std::setprecision(2) << ttd << " secs" << std::endl;
+	bench_log << "hash layout " << hash::layout_name() << std::endl;
+	if constexpr (use_hash_stats)
+	{
+		bench_log << "hash hits " << std::fixed << std::setprecision(1) << hit_rate << "%" << std::endl;
+		if (hc.q_probes)
+			bench_log << "qcache hits " << std::fixed << std::setprecision(1) << q_hit_rate << "%" << std::endl;
+	}
 
 	bench_log.close();
 	new_game();
 }
+
+// run the bench positions with 1, 2, 4 ... thread_limit threads and report nps and speedup over 1 thread
+// for every counter move history sharing mode; on multi-socket hosts every NUMA hash policy is measured
+// as well, so placement, history sharing and thread scaling can be compared. each run is repeated with
+// every smp mode, and since the depth is fixed the time is time-to-depth: 'ttd' is the time-to-depth
+// speedup over 1 thread and 'vs lazy' the time-to-depth speedup over lazy smp at the same thread count
+void bench_scale(const int depth, const int thread_limit)
+{
+	const auto saved_threads = thread_pool().thread_count;
+	const auto saved_policy = main_hash().numa_policy();
+	const auto saved_sharing = thread_pool().cmh_sharing;
+	const auto saved_smp_mode = thread_pool().smp_mode;
+
+	std::vector<int> thread_counts;
+	for (auto t = 1; t < thread_limit; t *= 2)
+		thread_counts.push_back(t);
+	thread_counts.push_back(thread_limit);
+
+	std::vector<numapolicy> policies{saved_policy};
+	std::vector<cmhsharing> sharings{cmh_shared, cmh_thread};
+	if (numa::node_count() > 1)
+	{
+		policies = {numa_off, numa_interleave, numa_local};
+		sharings = {cmh_shared, cmh_node, cmh_thread};
+	}
+
+	std::ostringstream ss;
+	ss << program << " " << version << " " << platform << " " << bmis << std::endl;
+	ss << "depth " << depth << " numa nodes " << numa::node_count()
+		<< " cmh merge " << thread_pool().cmh_merge << std::endl;
+
+	for (const auto policy : policies)
+		for (const auto sharing : sharings)
+		{
+			main_hash().numa_policy(policy);
+			thread_pool().share_counter_move_history(sharing);
+			std::vector<double> lazy_times(thread_counts.size());
+
+			for (const auto smp_mode : {smp_lazy, smp_abdada})
+			{
+				thread_pool().smp_mode = smp_mode;
+				double base_nps = 0, base_time = 0;
+
+				for (size_t t = 0; t < thread_counts.size(); ++t)
+				{
+					const auto threads = thread_counts[t];
+					thread_pool().change_thread_count(threads);
+
+					const auto start_time = now();
+					const auto nodes = search_positions(depth, false);
+					const auto elapsed_time = static_cast<double>(now() + 1 - start_time) / 1000;
+					const auto nps = static_cast<double>(nodes) / elapsed_time;
+					if (threads == 1)
+					{
+						base_nps = nps;
+						base_time = elapsed_time;
+					}
+					if (smp_mode == smp_lazy)
+						lazy_times[t] = elapsed_time;
+
+					std::ostringstream line;
+					line << "numa " << std::setw(10) << std::left << numa::policy_name(policy)
+						<< " cmh " << std::setw(6) << cmh_sharing_name(sharing)
+						<< " smp " << std::setw(6) << smp_mode_name(smp_mode) << std::right
+						<< " threads " << std::setw(3) << threads
+						<< " nodes " << std::setw(12) << nodes
+						<< " time " << std::fixed << std::setprecision(2) << std::setw(8) << elapsed_time
+						<< " nps " << std::setprecision(0) << std::setw(10) << nps
+						<< " speedup " << std::setprecision(2) << (base_nps > 0 ? nps / base_nps : 0)
+						<< " ttd " << base_time / elapsed_time
+						<< " vs lazy " << lazy_times[t] / elapsed_time << std::endl;
+					acout() << line.str();
+					ss << line.str();
+				}
+			}
+		}
+
+	thread_pool().smp_mode = saved_smp_mode;
+	thread_pool().change_thread_count(saved_threads);
+	thread_pool().share_counter_move_history(saved_sharing);
+	main_hash().numa_policy(saved_policy);
+
+	const auto file_name = log_name("scale");
+	acout() << "\nsaved " << file_name << std::endl << std::endl;
+
+	std::ofstream scale_log(file_name);
+	scale_log << ss.str();
+	scale_log.close();
+	new_game();
+}
+
+// run the bench positions in several engine instances at once, each with its own hash and one thread,
+// and compare the total nps with a single instance
+void bench_instances(const int depth, const int instances)
+{
+	std::vector<uint64_t> nodes(instances);
+	std::vector<double> times(instances);
+
+	const auto run = [&](const int count)
+	{
+		std::vector<std::thread> drivers;
+		for (auto i = 0; i < count; ++i)
+			drivers.emplace_back([&, i]
+				{
+					auto* instance = new engine;
+					const auto start_time = now();
+					instance->init(uci_hash);
+					nodes[i] = search_positions(depth, false);
+					times[i] = static_cast<double>(now() + 1 - start_time) / 1000;
+					instance->exit();
+					delete instance;
+				});
+		for (auto& driver : drivers)
+			driver.join();
+
+		uint64_t total_nodes = 0;
+		auto elapsed_time = 0.0;
+		for (auto i = 0; i < count; ++i)
+		{
+			total_nodes += nodes[i];
+			elapsed_time = std::max(elapsed_time, times[i]);
+		}
+		return static_cast<double>(total_nodes) / elapsed_time;
+	};
+
+	const auto base_nps = run(1);
+	const auto nps = run(instances);
+
+	std::ostringstream ss;
+	ss << "instances " << instances << " depth " << depth << std::endl;
+	for (auto i = 0; i < instances; ++i)
+		ss << "instance " << std::setw(3) << i << " nodes " << std::setw(12) << nodes[i]
+			<< " time " << std::fixed << std::setprecision(2) << std::setw(8) << times[i] << std::endl;
+	ss << "nps " << std::fixed << std::setprecision(0) << nps
+		<< " single instance nps " << base_nps
+		<< " speedup " << std::setprecision(2) << nps / base_nps << std::endl;
+	acout() << ss.str();
+}
+
+// solve mate problems with 'go mate n' twice, with the proof-number mate solver and with the regular search,
+// and compare time and nodes. the problems are the built-in suite or the epd lines of file with a dm operation
+void bench_mate(const int move_time, const std::string& file)
+{
+	std::vector<std::string> lines;
+	if (file.empty())
+		lines.assign(std::begin(mate_positions), std::end(mate_positions));
+	else
+	{
+		std::ifstream in(file);
+		if (!in)
+		{
+			acout() << "info string cannot open " << file << std::endl;
+			return;
+		}
+		for (std::string line; std::getline(in, line);)
+			lines.push_back(line);
+	}
+
+	const auto saved_solver = uci_mate_solver;
+
+	struct mate_run
+	{
+		int found;
+		double time;
+		uint64_t nodes;
+	};
+
+	// the mate length found within n moves, or 0
+	const auto solve = [&](const std::string& fen, const int n, const bool use_solver)
+	{
+		uci_mate_solver = use_solver;
+		search::reset();
+		position pos{};
+		pos.set(fen, false, thread_pool().main());
+		std::istringstream iss("mate " + std::to_string(n) + " movetime " + std::to_string(move_time));
+		const auto start_time = now();
+		go(pos, iss);
+		thread_pool().main()->wait_for_search_to_end();
+		const auto elapsed_time = static_cast<double>(now() + 1 - start_time) / 1000;
+		const auto score = thread_pool().main()->root_moves[0].score;
+		const auto found = score >= longest_mate_score && mate_score - score <= 2 * n ? (mate_score - score + 1) / 2 : 0;
+		return mate_run{found, elapsed_time, thread_pool().visited_nodes()};
+	};
+
+	std::ostringstream ss;
+	ss << program << " " << version << " " << platform << " " << bmis << std::endl;
+	ss << "movetime " << move_time << std::endl;
+
+	auto problems = 0, solver_solved = 0, search_solved = 0;
+	double solver_time = 0, search_time = 0;
+	uint64_t solver_nodes = 0, search_nodes = 0;
+
+	for (const auto& line : lines)
+	{
+		// the first four fields are the fen, the mate length is the operand of dm
+		std::istringstream is(line);
+		std::string fen, field;
+		for (auto i = 0; i < 4 && is >> field; ++i)
+			fen += (i ? " " : "") + field;
+		auto n = 0;
+		while (is >> field)
+			if (field == "dm" && is >> field)
+				n = std::atoi(field.c_str());
+		if (n <= 0)
+			continue;
+
+		problems++;
+		const auto solver = solve(fen, n, true);
+		const auto search = solve(fen, n, false);
+		solver_solved += solver.found > 0;
+		search_solved += search.found > 0;
+		solver_time += solver.time;
+		search_time += search.time;
+		solver_nodes += solver.nodes;
+		search_nodes += search.nodes;
+
+		std::ostringstream out;
+		out << "problem " << std::setw(3) << problems << " dm " << std::setw(2) << n
+			<< " solver mate " << std::setw(2) << solver.found
+			<< " time " << std::fixed << std::setprecision(2) << std::setw(7) << solver.time
+			<< " nodes " << std::setw(10) << solver.nodes
+			<< " search mate " << std::setw(2) << search.found
+			<< " time " << std::setw(7) << search.time
+			<< " nodes " << std::setw(10) << search.nodes << "  " << fen << std::endl;
+		acout() << out.str();
+		ss << out.str();
+	}
+
+	uci_mate_solver = saved_solver;
+
+	std::ostringstream total;
+	total << "solver solved " << solver_solved << '/' << problems
+		<< " time " << std::fixed << std::setprecision(2) << solver_time << " nodes " << solver_nodes << std::endl
+		<< "search solved " << search_solved << '/' << problems
+		<< " time " << search_time << " nodes " << search_nodes << std::endl
+		<< "speedup " << (solver_time > 0 ? search_time / solver_time : 0) << std::endl;
+	acout() << total.str();
+	ss << total.str();
+
+	const auto file_name = log_name("benchmate");
+	acout() << "\nsaved " << file_name << std::endl << std::endl;
+
+	std::ofstream mate_log(file_name);
+	mate_log << ss.str();
+	mate_log.close();
+	new_game();
+}
@@ -88,3 +88,14 @@ static const char* bench_positions[] =
 	"4n3/p5k1/2P3pp/2P5/P3pp2/2K3P1/5r1P/R4N2 w - -",
 	"6k1/p7/6pp/1p1Pp3/2n1P1Pb/6NP/P4KP1/B7 w - -"
 };
+
+// mate problems for 'benchmate', epd lines with the mate length as dm operation
+static const char* mate_positions[] =
+{
+	"r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - dm 1;",
+	"6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - dm 1;",
+	"7k/8/6K1/8/8/8/8/R7 w - - dm 1;",
+	"r2qkb1r/pp2nppp/3p4/2pNN1B1/2BnP3/3P4/PPP2PPP/R2bK2R w KQkq - dm 2;",
+	"4k3/8/8/8/8/8/R7/1R2K3 w - - dm 2;",
+	"8/8/8/4k3/8/8/8/3QK3 w - - dm 7;"
+};
@@ -20,6 +20,7 @@
 #include <fstream>
 #include <string>
 
+#include "../engine.h"
 #include "../fire.h"
 #include "../position.h"
 #include "../thread.h"
@@ -86,7 +87,7 @@ void perft(int depth, std::string& fen)
 			while (getline(file, fen_pos))
 			{
 				position pos{};
-				pos.set(fen_pos, false, thread_pool.main());
+				pos.set(fen_pos, false, thread_pool().main());
 				acout() << pos;
 
 				// start perft
@@ -130,7 +131,7 @@ void perft(int depth, std::string& fen)
 	{
 		// otherwise use the fen specified 
 		position pos{};
-		pos.set(fen, false, thread_pool.main());
+		pos.set(fen, false, thread_pool().main());
 		acout() << pos;
 		acout() << "" << fen.c_str() << std::endl;
 		acout() << "depth " << depth << std::endl;
@@ -214,7 +215,7 @@ void divide(int depth, std::string& fen)
 			while (getline(file, fen_pos))
 			{
 				position pos{};
-				pos.set(fen_pos, false, thread_pool.main());
+				pos.set(fen_pos, false, thread_pool().main());
 				acout() << pos;
 				acout() << fen_pos.c_str() << std::endl;
 				acout() << "depth " << depth << std::endl;
@@ -266,7 +267,7 @@ void divide(int depth, std::string& fen)
 	else
 	{
 		position pos{};
-		pos.set(fen, false, thread_pool.main());
+		pos.set(fen, false, thread_pool().main());
 		acout() << pos;
 		acout() << fen.c_str() << std::endl;
 		acout() << "depth " << depth << std::endl;
@@ -75,7 +75,7 @@ namespace util
 		ci << "info string " << sys_info.dwNumberOfProcessors << " available cores" << std::endl;
 #else
 		// if linux
-		ss << "info string " << sysconf(_SC_NPROCESSORS_ONLN) << " available cores" << std::endl;
+		ci << "info string " << sysconf(_SC_NPROCESSORS_ONLN) << " available cores" << std::endl;
 #endif
 
 		return ci.str();
@@ -245,12 +245,26 @@ namespace util
 				str = move_to_string(make_move(castle_move, pos.king(pos.on_move()), relative_square(pos.on_move(), c1)), pos);
 		}
 
-		if (str.length() == 5)
-			str[4] = static_cast<char>(tolower(str[4]));
+		if (str.length() < 4 || str.length() > 5
+			|| str[0] < 'a' || str[0] > 'h' || str[1] < '1' || str[1] > '8'
+			|| str[2] < 'a' || str[2] > 'h' || str[3] < '1' || str[3] > '8')
+			return no_move;
 
+		const auto from = make_square(static_cast<file>(str[0] - 'a'), static_cast<rank>(str[1] - '1'));
+		const auto to = make_square(static_cast<file>(str[2] - 'a'), static_cast<rank>(str[3] - '1'));
+		const auto promotion = str.length() == 5 ? static_cast<char>(tolower(str[4])) : ' ';
+
+		// compare squares with the generated moves rather than formatting each of them
 		for (const auto& new_move : legal_move_list(pos))
-			if (str == move_to_string(new_move, pos))
+		{
+			auto new_to = to_square(new_move);
+			if (move_type(new_move) == castle_move && pos.is_chess960())
+				new_to = pos.castle_rook_square(new_to);
+
+			if (from_square(new_move) == from && new_to == to
+				&& (new_move < static_cast<uint32_t>(promotion_p) ? promotion == ' ' : "   nbrq"[promotion_piece(new_move)] == promotion))
 				return new_move;
+		}
 
 		return no_move;
 	}
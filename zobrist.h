@@ -27,4 +27,27 @@ namespace zobrist
 	inline uint64_t castle[castle_possible_n];
 	inline uint64_t on_move;
 	inline uint64_t hash_50_move[32];
+
+	// fingerprint of the key tables: a saved hash only holds usable entries for a process that
+	// derives the same keys, so the fingerprint is stored with it and compared on load
+	inline uint64_t scheme()
+	{
+		uint64_t h = 0xcbf29ce484222325ull;
+		const auto mix = [&h](const uint64_t k)
+		{
+			h = (h ^ k) * 0x100000001b3ull;
+		};
+
+		for (const auto& keys : psq)
+			for (const auto k : keys)
+				mix(k);
+		for (const auto k : enpassant)
+			mix(k);
+		for (const auto k : castle)
+			mix(k);
+		for (const auto k : hash_50_move)
+			mix(k);
+		mix(on_move);
+		return h;
+	}
 }